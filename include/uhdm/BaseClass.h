@@ -40,6 +40,7 @@
 
 namespace uhdm {
 class BaseClass;
+class Factory;
 class Serializer;
 class UhdmComparer;
 
@@ -71,23 +72,52 @@ class CloneContext : public RTTI {
 class BaseClass : public RTTI {
   UHDM_IMPLEMENT_RTTI(BaseClass, RTTI)
   friend Serializer;
+  friend Factory;
 
  public:
   static constexpr UhdmType kUhdmType = UhdmType::BaseClass;
 
-  // Use implicit constructor to initialize all members
-  // BaseClass()
+  // The flags are bitfields, initialized here.
+  BaseClass()
+      : m_pendingRestore(false),
+        m_modified(false),
+        m_dirty(true),
+        m_unindexed(true),
+        m_hasClientData(false) {}
 
   virtual ~BaseClass() = default;
 
+  // Copies restore a lazily restored source first so that the members of
+  // the derived classes are complete by the time they get copied.
+  BaseClass& operator=(const BaseClass& rhs);
+
   Serializer* getSerializer() const { return m_serializer; }
 
   uint32_t getUhdmId() const { return m_uhdmId; }
   bool setUhdmId(uint32_t data) {
     m_uhdmId = data;
+    touch();
     return true;
   }
 
+  // Position of this object among the objects of its type in the owning
+  // Factory. Dense per type, it changes when objects of the same type are
+  // erased.
+  uint32_t getSlot() const { return m_slot; }
+
+  // Whether this object changed since the last full save or restore, see
+  // Serializer::SaveOptions::delta. Setters flag it, and so does getting a
+  // collection to fill it with get<Collection>(true).
+  bool isModified() const { return m_modified; }
+
+  // Flags the object as changed, for delta saves, changed garbage collection
+  // and the referrer index. Setters call it. Callers editing in place a
+  // collection got with get<Collection>() call it on the owner.
+  void touch() {
+    m_modified = true;
+    if (!m_dirty || !m_unindexed) onTouched();
+  }
+
   BaseClass* getParent() { return m_parent; }
   const BaseClass* getParent() const { return m_parent; }
   template <typename T>
@@ -106,40 +136,47 @@ class BaseClass : public RTTI {
   uint32_t getStartLine() const { return m_startLine; }
   bool setStartLine(uint32_t data) {
     m_startLine = data;
+    touch();
     return true;
   }
 
   uint16_t getStartColumn() const { return m_startColumn; }
   bool setStartColumn(uint16_t data) {
     m_startColumn = data;
+    touch();
     return true;
   }
 
   uint32_t getEndLine() const { return m_endLine; }
   bool setEndLine(uint32_t data) {
     m_endLine = data;
+    touch();
     return true;
   }
 
   uint16_t getEndColumn() const { return m_endColumn; }
   bool setEndColumn(uint16_t data) {
     m_endColumn = data;
+    touch();
     return true;
   }
 
   virtual std::string_view getName() const { return kEmpty; }
+  // Id of getName() in the symbols of the serializer, BadSymbolId if none.
+  virtual SymbolId getNameId() const { return BadSymbolId; }
   virtual std::string_view getDefName() const { return kEmpty; }
 
   virtual uint32_t getVpiType() const = 0;
   virtual UhdmType getUhdmType() const = 0;
 
-  ClientData* getClientData() { return m_clientData; }
-  const ClientData* getClientData() const { return m_clientData; }
-  void setClientData(ClientData* data) { m_clientData = data; }
+  // Few objects carry client data, it is held aside by the serializer.
+  ClientData* getClientData();
+  const ClientData* getClientData() const;
+  void setClientData(ClientData* data);
 
-  // TODO: Make the next three functions pure-virtual after transition to pygen.
-  virtual const BaseClass* getByVpiName(std::string_view name) const;
+  const BaseClass* getByVpiName(std::string_view name) const;
 
+  // TODO: Make the next two functions pure-virtual after transition to pygen.
   using get_by_vpi_type_return_t =
       std::tuple<UhdmType, const BaseClass*,
                  const std::vector<const BaseClass*>*>;
@@ -155,19 +192,43 @@ class BaseClass : public RTTI {
   virtual int32_t compare(const BaseClass* other,
                           UhdmComparer* comparer) const;
 
+  // Appends the objects this object refers to, the parent first, duplicates
+  // and all. These are the relations compare() and swap() look at.
+  virtual void collectReferences(
+      std::vector<const BaseClass*>& references) const;
+
  protected:
   void deepCopy(BaseClass* clone, BaseClass* parent,
                 CloneContext* context) const;
 
   std::string computeFullName() const;
 
+  // Names are compared by symbol id, the name is only hashed once by
+  // getByVpiName().
+  virtual const BaseClass* findByVpiName(SymbolId nameId,
+                                         std::string_view name) const;
+  static bool isNamed(const BaseClass* any, SymbolId nameId,
+                      std::string_view name) {
+    const SymbolId id = any->getNameId();
+    return id ? (id == nameId) : (any->getName() == name);
+  }
+
+  // Objects created by a lazy restore carry only their properties and parent
+  // until first accessed; every accessor of a relation calls this first.
+  void materialize() const {
+    if (m_pendingRestore) materializeRelations();
+  }
+
   void setSerializer(Serializer* serializer) { m_serializer = serializer; }
 
   virtual void swap(const BaseClass* what, BaseClass* with);
   virtual void swap(const std::map<const BaseClass*, BaseClass*>& replacements);
 
+  // Appends the symbols held by this object, duplicates and all.
+  virtual void collectSymbols(std::vector<SymbolId>& symbols) const;
+
   template <typename T>
-  static void swapT(std::vector<T*>& collection, const BaseClass* what,
+  static bool swapT(std::vector<T*>& collection, const BaseClass* what,
                     BaseClass* with) {
     auto it = std::find(collection.begin(), collection.end(), what);
     if (it != collection.end()) {
@@ -178,18 +239,20 @@ class BaseClass : public RTTI {
       } else {
         collection.erase(it);
       }
+      return true;
     }
+    return false;
   }
 
   template <typename T>
-  static void swapT(
+  static bool swapT(
       std::vector<T*>& collection,
       const std::map<const BaseClass*, BaseClass*>& replacements) {
     if (!std::any_of(collection.cbegin(), collection.cend(),
                      [&replacements](const BaseClass* const any) {
                        return replacements.find(any) != replacements.cend();
                      })) {
-      return;
+      return false;
     }
 
     AnySet unique;
@@ -209,16 +272,23 @@ class BaseClass : public RTTI {
         if (unique.emplace(whatT).second) collection.emplace_back(whatT);
       }
     }
+    return true;
   }
 
   virtual void onChildAdded(BaseClass* child) {}
   virtual void onChildRemoved(BaseClass* child) {}
 
+ private:
+  void materializeRelations() const;
+  // Flags the object dirty and unindexed, queuing it on its serializer for
+  // the next changed garbage collection and to be indexed again.
+  void onTouched();
+
  protected:
   Serializer* m_serializer = nullptr;
-  ClientData* m_clientData = nullptr;
 
   uint32_t m_uhdmId = 0;
+  uint32_t m_slot = 0;
   BaseClass* m_parent = nullptr;
   SymbolId m_fileId = BadSymbolId;
 
@@ -226,6 +296,17 @@ class BaseClass : public RTTI {
   uint32_t m_endLine = 0;
   uint16_t m_startColumn = 0;
   uint16_t m_endColumn = 0;
+  // Flags share the byte after the columns, the derived classes lay their
+  // members out in the padding left after it.
+  bool m_pendingRestore : 1;
+  bool m_modified : 1;
+  // Made or changed since the last garbage collection, see
+  // Serializer::collectChangedGarbage().
+  bool m_dirty : 1;
+  // Made or changed since the serializer indexed its references, see
+  // Serializer::indexReferrers().
+  bool m_unindexed : 1;
+  bool m_hasClientData : 1;
 };
 
 using Any = BaseClass;
@@ -0,0 +1,55 @@
+/*
+ Copyright 2019 Alain Dargelas
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+/*
+ * File:   BlockCodec.h
+ * Author:
+ *
+ * Created on October 16, 2026
+ */
+
+#ifndef UHDM_BLOCKCODEC_H
+#define UHDM_BLOCKCODEC_H
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace uhdm {
+
+// Byte oriented LZ77 compression of independent blocks, tuned for fast
+// decompression rather than ratio. A block is a sequence of literal runs, each
+// followed by a copy of earlier output of the same block, so blocks can be
+// decompressed in any order and from several threads.
+class BlockCodec final {
+ public:
+  // Upper bound of the compressed size of a block of the given size.
+  static size_t getMaxCompressedSize(size_t size);
+
+  // Compresses size bytes of src into dst, which must hold
+  // getMaxCompressedSize(size) bytes. Returns the compressed size.
+  static size_t compress(const uint8_t* src, size_t size, uint8_t* dst);
+
+  // Decompresses size bytes of src into exactly dstSize bytes of dst.
+  // Returns false if the block is malformed or doesn't decompress to
+  // dstSize bytes.
+  static bool decompress(const uint8_t* src, size_t size, uint8_t* dst,
+                         size_t dstSize);
+};
+
+}  // namespace uhdm
+
+#endif  // UHDM_BLOCKCODEC_H
@@ -28,19 +28,26 @@
 
 #include <uhdm/SymbolId.h>
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
 namespace uhdm {
 class Serializer;
 
+// Symbols can be added and looked up from several threads at once. Lookups
+// take no lock; adding a new symbol locks one of kShardCount shards, picked
+// by the hash of the symbol. Ids are handed out densely, in the order the
+// symbols are added. getSymbols() and purge() must not run concurrently with
+// add().
 class SymbolFactory {
  public:
   SymbolFactory();
-  ~SymbolFactory() = default;
+  ~SymbolFactory();
 
   // Must never copy: expensive, and string locations would not be stable.
   // It would also be a programming error.
@@ -77,6 +84,20 @@ class SymbolFactory {
   // used as an index into this  vector to get the corresponding text-symbol.
   std::vector<std::string_view> getSymbols() const;
 
+  // Appends count symbols that are all different and not in this table yet,
+  // with consecutive ids. Their text is copied at once, they are only hashed
+  // and indexed on the next add() or lookup. Not safe concurrently with
+  // anything else.
+  void appendUnique(const std::string_view* symbols, size_t count);
+
+  // Number of symbols of this table, not counting its parent.
+  RawSymbolId getSymbolCount() const {
+    return m_idCounter.load(std::memory_order_acquire);
+  }
+
+  // Estimated bytes held by this table, not counting its parent.
+  size_t getMemoryUsage() const;
+
   static std::string_view getBadSymbol() { return BadRawSymbol; }
   static SymbolId getBadId() { return BadSymbolId; }
   static std::string_view getEmptyMacroMarker();
@@ -85,26 +106,97 @@ class SymbolFactory {
   // Create a snapshot of the current symbol table. Private, as this
   // functionality should be explicitly accessed through CreateSnapshot().
   SymbolFactory(const SymbolFactory& parent)
-      : m_parent(&parent), m_idOffset(parent.m_idCounter + parent.m_idOffset) {}
+      : m_parent(&parent),
+        m_idOffset(parent.getSymbolCount() + parent.m_idOffset) {}
 
  private:
+  static constexpr uint32_t kShardCount = 16;
+  // Symbols by id are held in segments of doubling size, the first one of
+  // 1 << kFirstSegmentBits. They never move once written.
+  static constexpr uint32_t kFirstSegmentBits = 10;
+  static constexpr uint32_t kSegmentCount = 33 - kFirstSegmentBits;
+  // Arena chunks double in size between these.
+  static constexpr size_t kMinArenaChunkSize = 1024;
+  static constexpr size_t kMaxArenaChunkSize = 64 * 1024;
+
+  // A symbol in the arena: its hash and size, followed by its text. The hash
+  // is computed once, when the symbol is added.
+  struct Entry final {
+    std::string_view getText() const {
+      return std::string_view(reinterpret_cast<const char*>(this + 1), m_size);
+    }
+
+    size_t m_hash;
+    uint32_t m_size;
+  };
+
+  // Open addressing table of the ids of a shard, plus one so zero is empty.
+  // It is replaced by one twice as large when half full; readers may still
+  // probe the replaced ones, they are kept until purge().
+  struct Table final {
+    explicit Table(size_t capacity)
+        : m_mask(capacity - 1),
+          m_slots(new std::atomic<RawSymbolId>[capacity]) {
+      for (size_t i = 0; i < capacity; ++i) m_slots[i].store(0);
+    }
+
+    // Stores the id plus one, slot in the first empty slot from h.
+    void place(size_t h, RawSymbolId slot);
+
+    const size_t m_mask;
+    std::unique_ptr<std::atomic<RawSymbolId>[]> m_slots;
+  };
+
+  struct Shard final {
+    std::mutex m_mutex;
+    std::atomic<Table*> m_table{nullptr};
+    std::vector<std::unique_ptr<Table>> m_tables;
+    size_t m_count = 0;
+
+    // Bump arena of the entries of the shard, they never move.
+    std::vector<std::unique_ptr<char[]>> m_chunks;
+    char* m_chunkNext = nullptr;
+    size_t m_chunkLeft = 0;
+    size_t m_chunkSize = 0;  // Of all chunks, for getMemoryUsage().
+  };
+
   void purge();
   void appendSymbols(int64_t up_to, std::vector<std::string_view>* dest) const;
 
-  using Id2SymbolMap = std::deque<std::string>;
-  using Symbol2IdMap = std::unordered_map<std::string_view, RawSymbolId>;
+  static size_t hash(std::string_view symbol) {
+    return std::hash<std::string_view>()(symbol);
+  }
+
+  // Hashes and indexes the symbols of appendUnique(), if any are left.
+  void index();
+
+  // Looks the symbol up in one shard, returns its own id plus one, or zero.
+  RawSymbolId find(const Shard& shard, size_t h, std::string_view symbol) const;
+
+  // Of the symbols of this table, ids not counting the parent's.
+  const Entry* getOwnEntry(RawSymbolId rid) const;
+  std::string_view getOwnSymbol(RawSymbolId rid) const;
+  void setOwnEntry(RawSymbolId rid, const Entry* entry);
+
+  // Bytes taken in the arena by the entry of the symbol.
+  static size_t getEntrySize(std::string_view symbol);
+  static const Entry* writeEntry(char* storage, size_t h,
+                                 std::string_view symbol);
+  const Entry* store(Shard& shard, size_t h, std::string_view symbol);
+  void insert(Shard& shard, size_t h, RawSymbolId rid);
 
   const SymbolFactory *const m_parent;
   const RawSymbolId m_idOffset;
 
-  RawSymbolId m_idCounter = 0;
+  std::atomic<RawSymbolId> m_idCounter{0};
 
-  // Stable strings whose address doesn't change with reallocations.
-  Id2SymbolMap m_id2SymbolMap;
+  // Ids from m_unindexedFrom on aren't in the lookup tables yet.
+  std::atomic<bool> m_unindexed{false};
+  RawSymbolId m_unindexedFrom = 0;
+  std::mutex m_indexMutex;
 
-  // The key string_views point to the stable backing buffer provided in
-  // m_id2SymbolMap
-  Symbol2IdMap m_symbol2IdMap;
+  std::array<std::atomic<const Entry**>, kSegmentCount> m_segments{};
+  std::array<Shard, kShardCount> m_shards;
 
   friend Serializer;
 };
@@ -0,0 +1,83 @@
+/*
+ Copyright 2019 Alain Dargelas
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+/*
+ * File:   ThreadPool.h
+ * Author:
+ *
+ * Created on October 16, 2026
+ */
+
+#ifndef UHDM_THREADPOOL_H
+#define UHDM_THREADPOOL_H
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace uhdm {
+
+// Fixed size pool of worker threads draining a shared FIFO of tasks.
+// Tasks must not submit into the pool they run on and wait for it.
+class ThreadPool final {
+ public:
+  using task_t = std::function<void()>;
+
+  // A thread count of 0 uses the hardware concurrency.
+  explicit ThreadPool(uint32_t threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  uint32_t getThreadCount() const {
+    return static_cast<uint32_t>(m_threads.size());
+  }
+
+  void submit(task_t task);
+
+  // Blocks until every submitted task has run. Rethrows the first exception
+  // thrown by a task, if any.
+  void wait();
+
+  // Runs fn(0) ... fn(count - 1) on up to threadCount threads, including the
+  // calling one, and returns when all are done. Runs inline when threadCount
+  // is 1 or there is a single item.
+  static void parallelFor(uint32_t threadCount, size_t count,
+                          const std::function<void(size_t)>& fn);
+
+ private:
+  void run();
+
+  std::vector<std::thread> m_threads;
+  std::deque<task_t> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_taskReady;
+  std::condition_variable m_allDone;
+  size_t m_busy = 0;
+  bool m_stopping = false;
+  std::exception_ptr m_error;
+};
+
+}  // namespace uhdm
+
+#endif  // UHDM_THREADPOOL_H
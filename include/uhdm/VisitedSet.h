@@ -0,0 +1,150 @@
+/*
+ Copyright 2019 Alain Dargelas
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+/*
+ * File:   VisitedSet.h
+ * Author:
+ *
+ * Created on October 16, 2026
+ */
+
+#ifndef UHDM_VISITEDSET_H
+#define UHDM_VISITEDSET_H
+#pragma once
+
+#include <uhdm/BaseClass.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace uhdm {
+
+// Set of objects met during a traversal, indexed by their uhdm id. Ids are
+// dense within a Serializer, so membership is a lookup in a table of pages
+// allocated on first use instead of a walk down a tree. Objects sharing an id
+// with another member, i.e. coming from another Serializer, go to an ordinary
+// set. Iteration follows ids rather than addresses; use toSet() where the
+// ordering of std::set is needed. Like with unordered containers, inserting
+// may invalidate iterators.
+class VisitedSet final {
+ public:
+  using value_type = const Any*;
+  using key_type = const Any*;
+  using size_type = size_t;
+
+  class const_iterator final {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = const Any*;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    const_iterator() = default;
+
+    reference operator*() const;
+    pointer operator->() const { return &**this; }
+
+    const_iterator& operator++();
+    const_iterator operator++(int) {
+      const_iterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return (m_index == other.m_index) && (m_other == other.m_other);
+    }
+    bool operator!=(const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class VisitedSet;
+    const_iterator(const VisitedSet* set, size_t index,
+                   std::set<const Any*>::const_iterator other)
+        : m_set(set), m_index(index), m_other(other) {}
+
+    void skipEmpty();
+
+    const VisitedSet* m_set = nullptr;
+    // Index in the table, or getCapacity() once in the overflow set.
+    size_t m_index = 0;
+    std::set<const Any*>::const_iterator m_other;
+  };
+  using iterator = const_iterator;
+
+  VisitedSet() = default;
+  VisitedSet(const VisitedSet& other) { *this = other; }
+  VisitedSet(VisitedSet&& other) = default;
+  VisitedSet& operator=(const VisitedSet& other);
+  VisitedSet& operator=(VisitedSet&& other) = default;
+
+  // Same as std::set<const Any*>::insert, second is false if already there.
+  std::pair<const_iterator, bool> insert(const Any* any);
+  std::pair<const_iterator, bool> emplace(const Any* any) {
+    return insert(any);
+  }
+
+  bool contains(const Any* any) const {
+    const uint32_t id = any->getUhdmId();
+    const size_t page = id >> kPageBits;
+    if ((page < m_pages.size()) && m_pages[page]) {
+      const Any* const entry = m_pages[page][id & kPageMask];
+      if (entry == any) return true;
+      if (entry == nullptr) return false;
+    }
+    return !m_others.empty() && (m_others.find(any) != m_others.end());
+  }
+  size_t count(const Any* any) const { return contains(any) ? 1 : 0; }
+  const_iterator find(const Any* any) const;
+
+  size_t erase(const Any* any);
+  void clear();
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  const_iterator begin() const;
+  const_iterator end() const {
+    return const_iterator(this, getCapacity(), m_others.end());
+  }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  // Adapter for callers relying on the address ordering of std::set.
+  std::set<const Any*> toSet() const { return {begin(), end()}; }
+
+ private:
+  static constexpr uint32_t kPageBits = 12;
+  static constexpr uint32_t kPageSize = 1 << kPageBits;
+  static constexpr uint32_t kPageMask = kPageSize - 1;
+
+  size_t getCapacity() const { return m_pages.size() << kPageBits; }
+
+  std::vector<std::unique_ptr<const Any*[]>> m_pages;
+  std::set<const Any*> m_others;
+  size_t m_size = 0;
+};
+
+}  // namespace uhdm
+
+#endif  // UHDM_VISITEDSET_H
@@ -26,11 +26,66 @@ def _get_listen_implementation(classname, name, vpi, type, card):
     return listeners
 
 
+def _get_step_implementation(name, vpi, type, card, step):
+    steps = []
+
+    FuncName = config.make_func_name(name, card)
+    TypeName = config.make_class_name(type)
+
+    if card == '1':
+        suffix = 'Obj' if vpi in ['vpiName'] else ''
+        steps.append(f'    case {step}:')
+        steps.append(f'      frame.step = {step + 1};')
+        steps.append(f'      if (const Any *const any = object->get{FuncName}{suffix}()) {{')
+        steps.append(f'        *child = any;')
+        steps.append(f'        *vpiRelation = {vpi};')
+        steps.append( '        return true;')
+        steps.append( '      }')
+        steps.append( '      [[fallthrough]];')
+        return steps, step + 1
+
+    steps.append(f'    case {step}:')
+    steps.append(f'      frame.step = {step + 1};')
+    steps.append(f'      frame.index = 0;')
+    steps.append(f'      if ((frame.collection = object->get{FuncName}()) != nullptr) {{')
+    steps.append(f'        enter{TypeName}Collection(object, *static_cast<const {TypeName}Collection *>(frame.collection), {vpi});')
+    steps.append( '      }')
+    steps.append( '      [[fallthrough]];')
+    steps.append(f'    case {step + 1}:')
+    steps.append(f'      if (const {TypeName}Collection *const collection = static_cast<const {TypeName}Collection *>(frame.collection)) {{')
+    steps.append( '        if (frame.index < collection->size()) {')
+    steps.append( '          *child = (*collection)[frame.index++];')
+    steps.append(f'          *vpiRelation = {vpi};')
+    steps.append( '          return true;')
+    steps.append( '        }')
+    steps.append(f'        leave{TypeName}Collection(object, *collection, {vpi});')
+    steps.append( '        frame.collection = nullptr;')
+    steps.append( '      }')
+    steps.append(f'      frame.step = {step + 2};')
+    steps.append( '      [[fallthrough]];')
+    return steps, step + 2
+
+
+def _get_relations(model, models):
+    # Same order as the recursive listener, base classes first.
+    relations = []
+    basename = model.get('extends')
+    if basename:
+        relations.extend(_get_relations(models[basename], models))
+
+    for key, value in model.allitems():
+        if key in ['class', 'obj_ref', 'class_ref', 'group_ref']:
+            type = 'any' if key == 'group_ref' else value.get('type')
+            relations.append((value.get('name'), value.get('vpi'), type, value.get('card')))
+    return relations
+
+
 def generate(models):
     private_declarations = []
     private_implementations = []
     public_declarations = []
     public_implementations = []
+    step_implementations = []
     ClassNames = set()
 
     for model in models.values():
@@ -80,10 +135,35 @@ def generate(models):
             public_implementations.append( '}')
             public_implementations.append( '')
 
+            private_declarations.append(f'  bool step{ClassName}_(Frame &frame, const Any **child, uint32_t *vpiRelation);')
+            relations = _get_relations(model, models)
+            if relations:
+                step_implementations.append(f'bool UhdmListener::step{ClassName}_(Frame &frame, const Any **child, uint32_t *vpiRelation) {{')
+                step_implementations.append(f'  const {ClassName} *const object = static_cast<const {ClassName} *>(frame.object);')
+                step_implementations.append( '  switch (frame.step) {')
+                step = 0
+                for name, vpi, type, card in relations:
+                    steps, step = _get_step_implementation(name, vpi, type, card, step)
+                    step_implementations.extend(steps)
+                step_implementations.append( '    default: break;')
+                step_implementations.append( '  }')
+                step_implementations.append( '  return false;')
+            else:
+                step_implementations.append(f'bool UhdmListener::step{ClassName}_(Frame & /* frame */, const Any ** /* child */, uint32_t * /* vpiRelation */) {{')
+                step_implementations.append( '  return false;')
+            step_implementations.append( '}')
+            step_implementations.append( '')
+
     any_implementation = []
+    enter_frame_implementation = []
+    leave_frame_implementation = []
+    step_frame_implementation = []
     enter_leave_declarations = []
     for ClassName in sorted(ClassNames):
         any_implementation.append(f'    case UhdmType::{ClassName}: listen{ClassName}(static_cast<const {ClassName} *>(object), vpiRelation); break;')
+        enter_frame_implementation.append(f'    case UhdmType::{ClassName}: enter{ClassName}(static_cast<const {ClassName} *>(object), vpiRelation); return true;')
+        leave_frame_implementation.append(f'    case UhdmType::{ClassName}: leave{ClassName}(static_cast<const {ClassName} *>(object), vpiRelation); break;')
+        step_frame_implementation.append(f'    case UhdmType::{ClassName}: return step{ClassName}_(frame, child, vpiRelation);')
 
         enter_leave_declarations.append(f'  virtual void enter{ClassName}(const {ClassName}* object, uint32_t vpiRelation) {{}}')
         enter_leave_declarations.append(f'  virtual void leave{ClassName}(const {ClassName}* object, uint32_t vpiRelation) {{}}')
@@ -114,7 +194,11 @@ def generate(models):
 
     file_content = file_content.replace('<UHDM_PRIVATE_LISTEN_IMPLEMENTATIONS>', '\n'.join(private_implementations))
     file_content = file_content.replace('<UHDM_PUBLIC_LISTEN_IMPLEMENTATIONS>', '\n'.join(public_implementations))
+    file_content = file_content.replace('<UHDM_STEP_IMPLEMENTATIONS>', '\n'.join(step_implementations))
     file_content = file_content.replace('<UHDM_LISTENANY_IMPLEMENTATION>', '\n'.join(any_implementation))
+    file_content = file_content.replace('<UHDM_ENTER_FRAME_IMPLEMENTATION>', '\n'.join(enter_frame_implementation))
+    file_content = file_content.replace('<UHDM_LEAVE_FRAME_IMPLEMENTATION>', '\n'.join(leave_frame_implementation))
+    file_content = file_content.replace('<UHDM_STEP_FRAME_IMPLEMENTATION>', '\n'.join(step_frame_implementation))
     file_utils.set_content_if_changed(config.get_output_source_filepath('UhdmListener.cpp'), file_content)
 
     return True
@@ -2,22 +2,32 @@ import config
 import file_utils
 
 
-def _get_listeners(classname, vpi, type, card):
-  listeners = []
+def _is_skipped(classname, vpi, card):
+  if card != '1':
+    return False
 
-  if card == '1':
-    # upward vpiModule, vpiInterface relation (when card == 1, pointing to the parent object) creates loops in visitors
-    if vpi in ['vpiParent', 'vpiInstance', 'vpiModule', 'vpiInterface', 'vpiUse', 'vpiProgram', 'vpiClassDefn', 'vpiPackage', 'vpiUdp']:
-        return listeners
+  # upward vpiModule, vpiInterface relation (when card == 1, pointing to the parent object) creates loops in visitors
+  if vpi in ['vpiParent', 'vpiInstance', 'vpiModule', 'vpiInterface', 'vpiUse', 'vpiProgram', 'vpiClassDefn', 'vpiPackage', 'vpiUdp']:
+    return True
+
+  if 'func_call' in classname and vpi == 'vpiFunction':
+    # Prevent stepping inside functions while processing calls (func_call, method_func_call) to them
+    return True
 
-    if 'func_call' in classname and vpi == 'vpiFunction':
-      # Prevent stepping inside functions while processing calls (func_call, method_func_call) to them
-      return listeners
+  if 'task_call' in classname and vpi == 'vpiTask':
+    # Prevent stepping inside tasks while processing calls (task_call, method_task_call) to them
+    return True
 
-    if 'task_call' in classname and vpi == 'vpiTask':
-      # Prevent stepping inside tasks while processing calls (task_call, method_task_call) to them
-      return listeners
+  return False
+
+
+def _get_listeners(classname, vpi, type, card):
+  listeners = []
 
+  if _is_skipped(classname, vpi, card):
+    return listeners
+
+  if card == '1':
     listeners.append(f'  if (vpiHandle itr = vpi_handle({vpi}, handle)) {{')
     listeners.append(f'    listenAny(itr);')
     listeners.append( '    vpi_free_object(itr);')
@@ -43,10 +53,59 @@ def _get_listeners(classname, vpi, type, card):
   return listeners
 
 
+def _get_steps(vpi, card, step):
+  steps = []
+
+  if card == '1':
+    steps.append(f'    case {step}:')
+    steps.append(f'      frame.step = {step + 1};')
+    steps.append(f'      if ((*child = vpi_handle({vpi}, frame.handle)) != nullptr) return true;')
+    steps.append( '      [[fallthrough]];')
+    return steps, step + 1
+
+  steps.append(f'    case {step}:')
+  steps.append(f'      frame.step = {step + 1};')
+  if 'vpiAll' in vpi:
+    steps.append(f'      uhdmAllIterator = true;')
+  steps.append(f'      frame.iterator = vpi_iterate({vpi}, frame.handle);')
+  steps.append( '      [[fallthrough]];')
+  steps.append(f'    case {step + 1}:')
+  steps.append( '      if (frame.iterator != nullptr) {')
+  steps.append( '        if ((*child = vpi_scan(frame.iterator)) != nullptr) return true;')
+  steps.append( '        vpi_free_object(frame.iterator);')
+  steps.append( '        frame.iterator = nullptr;')
+  steps.append( '      }')
+  if 'vpiAll' in vpi:
+    steps.append(f'      uhdmAllIterator = false;')
+    steps.append(f'      m_visited.clear();')
+    steps.append(f'      m_visited.emplace((const Any*)((const uhdm_handle*)frame.handle)->object);')
+  steps.append(f'      frame.step = {step + 2};')
+  steps.append( '      [[fallthrough]];')
+  return steps, step + 2
+
+
+def _get_relations(model, models):
+  # Same order as the recursive listener, base classes first.
+  relations = []
+  baseclass = model.get('extends')
+  if baseclass:
+    relations.extend(_get_relations(models[baseclass], models))
+
+  ClassName = config.make_class_name(model['name'])
+  for key, value in model.allitems():
+    if key in ['class', 'obj_ref', 'class_ref', 'group_ref']:
+      vpi  = value.get('vpi')
+      card = value.get('card')
+      if not _is_skipped(ClassName, vpi, card):
+        relations.append((vpi, card))
+  return relations
+
+
 def generate(models):
   private_declarations = []
   private_implementations = []
   public_implementations = []
+  step_implementations = []
   classnames = set()
 
   for model in models.values():
@@ -94,11 +153,35 @@ def generate(models):
       public_implementations.append(f'}}')
       public_implementations.append( '')
 
+      private_declarations.append(f'  bool step{ClassName}_(Frame& frame, vpiHandle* child);')
+      relations = _get_relations(model, models)
+      if relations:
+        step_implementations.append(f'bool VpiListener::step{ClassName}_(Frame& frame, vpiHandle* child) {{')
+        step_implementations.append( '  switch (frame.step) {')
+        step = 0
+        for vpi, card in relations:
+          steps, step = _get_steps(vpi, card, step)
+          step_implementations.extend(steps)
+        step_implementations.append( '    default: break;')
+        step_implementations.append( '  }')
+        step_implementations.append( '  return false;')
+      else:
+        step_implementations.append(f'bool VpiListener::step{ClassName}_(Frame& /* frame */, vpiHandle* /* child */) {{')
+        step_implementations.append( '  return false;')
+      step_implementations.append( '}')
+      step_implementations.append( '')
+
   any_implementation = []
   enter_leave_declarations = []
   public_declarations = []
+  enter_frame_implementation = []
+  leave_frame_implementation = []
+  step_frame_implementation = []
   for classname in sorted(classnames):
     any_implementation.append(f'    case UhdmType::{classname}: listen{classname}(handle); break;')
+    enter_frame_implementation.append(f'    case UhdmType::{classname}: enter{classname}((const {classname}*)object, handle); return true;')
+    leave_frame_implementation.append(f'    case UhdmType::{classname}: leave{classname}((const {classname}*)object, handle); break;')
+    step_frame_implementation.append(f'    case UhdmType::{classname}: return step{classname}_(frame, child);')
 
     enter_leave_declarations.append(f'  virtual void enter{classname}(const {classname}* object, vpiHandle handle) {{}}')
     enter_leave_declarations.append(f'  virtual void leave{classname}(const {classname}* object, vpiHandle handle) {{}}')
@@ -121,7 +204,11 @@ def generate(models):
 
   file_content = file_content.replace('<VPI_PRIVATE_LISTEN_IMPLEMENTATIONS>', '\n'.join(private_implementations))
   file_content = file_content.replace('<VPI_PUBLIC_LISTEN_IMPLEMENTATIONS>', '\n'.join(public_implementations))
+  file_content = file_content.replace('<VPI_STEP_IMPLEMENTATIONS>', '\n'.join(step_implementations))
   file_content = file_content.replace('<VPI_LISTENANY_IMPLEMENTATION>', '\n'.join(any_implementation))
+  file_content = file_content.replace('<VPI_ENTER_FRAME_IMPLEMENTATION>', '\n'.join(enter_frame_implementation))
+  file_content = file_content.replace('<VPI_LEAVE_FRAME_IMPLEMENTATION>', '\n'.join(leave_frame_implementation))
+  file_content = file_content.replace('<VPI_STEP_FRAME_IMPLEMENTATION>', '\n'.join(step_frame_implementation))
   file_utils.set_content_if_changed(config.get_output_source_filepath('VpiListener.cpp'), file_content)
 
   return True
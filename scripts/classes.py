@@ -209,10 +209,12 @@ def _get_declarations(name, type, vpi, card, real_type=''):
         if type == 'std::string':
             content.append(f'  std::string_view get{FuncName}() const{final};')
             content.append(f'  bool set{FuncName}(std::string_view data);')
+            if vpi == 'vpiName':
+                content.append(f'  SymbolId getNameId() const override {{ return m_{varName}; }}')
 
         elif type in ['int16_t', 'uint16_t', 'int32_t', 'uint32_t', 'int64_t', 'uint64_t', 'bool']:
             content.append(f'  {type} get{FuncName}() const{final} {{ return m_{varName}; }}')
-            content.append(f'  bool set{FuncName}({type} data) {{\n    m_{varName} = data;\n    return true;\n  }}')
+            content.append(f'  bool set{FuncName}({type} data) {{\n    m_{varName} = data;\n    touch();\n    return true;\n  }}')
 
         else:
             Type = config.make_class_name(type)
@@ -220,13 +222,14 @@ def _get_declarations(name, type, vpi, card, real_type=''):
             if vpi in ['vpiName']:
                 suffix = 'Obj'
                 content.append('  std::string_view getName() const final;')
+                content.append('  SymbolId getNameId() const final;')
                 content.append('  bool setName(std::string_view name);')
 
-            content.append(f'  {Type}* get{FuncName}{suffix}(){final} {{ return m_{varName}; }}')
-            content.append(f'  const {Type}* get{FuncName}{suffix}() const{final} {{ return m_{varName}; }}')
-            content.append(f'  template <typename T> T* get{FuncName}{suffix}() {{ return any_cast<T>(m_{varName}); }}')
-            content.append(f'  template <typename T> const T* get{FuncName}{suffix}() const {{ return any_cast<T>(m_{varName}); }}')
-            content.append(f'  bool set{FuncName}{suffix}({Type}* data) {{\n    {check}m_{varName} = data;\n    return true;\n  }}')
+            content.append(f'  {Type}* get{FuncName}{suffix}(){final} {{ materialize(); return m_{varName}; }}')
+            content.append(f'  const {Type}* get{FuncName}{suffix}() const{final} {{ materialize(); return m_{varName}; }}')
+            content.append(f'  template <typename T> T* get{FuncName}{suffix}() {{ materialize(); return any_cast<T>(m_{varName}); }}')
+            content.append(f'  template <typename T> const T* get{FuncName}{suffix}() const {{ materialize(); return any_cast<T>(m_{varName}); }}')
+            content.append(f'  bool set{FuncName}{suffix}({Type}* data) {{\n    {check}materialize();\n    m_{varName} = data;\n    touch();\n    return true;\n  }}')
 
             # if type == 'ref_typespec':
             #     content.append(f'  template <typename T> T* get{FuncName}Actual() {{ return (m_{varName} != nullptr) ? m_{varName}->template getActual<T>() : nullptr; }}')
@@ -235,10 +238,10 @@ def _get_declarations(name, type, vpi, card, real_type=''):
 
     elif card == 'any':
         TypeName = config.make_class_name(type)
-        content.append(f'  {TypeName}Collection* get{FuncName}() const {{ return m_{varName}; }}')
+        content.append(f'  {TypeName}Collection* get{FuncName}() const {{ materialize(); return m_{varName}; }}')
         content.append(f'  template<typename T> {TypeName}Collection* get{FuncName}(T) = delete;')
         content.append(f'  {TypeName}Collection* get{FuncName}(bool createIfNull);')
-        content.append(f'  bool set{FuncName}({TypeName}Collection* data) {{\n    {check}if ((m_{varName} == nullptr) || (data == nullptr)) {{\n      m_{varName} = data;\n      return true;\n    }}\n    return false;\n  }}')
+        content.append(f'  bool set{FuncName}({TypeName}Collection* data) {{\n    {check}materialize();\n    if ((m_{varName} == nullptr) || (data == nullptr)) {{\n      m_{varName} = data;\n      touch();\n      return true;\n    }}\n    return false;\n  }}')
 
     return '\n'.join(content)
 
@@ -253,13 +256,21 @@ def _get_implementations(classname, name, type, vpi, card):
 
     if vpi in ['vpiName'] and type == 'identifier':
         content.append(f'std::string_view {ClassName}::getName() const {{')
+        content.append( '  materialize();')
         content.append(f'  return (m_{varName} != nullptr) ? m_{varName}->getName() : kEmpty;')
         content.append( '}')
         content.append( '')
+        content.append(f'SymbolId {ClassName}::getNameId() const {{')
+        content.append( '  materialize();')
+        content.append(f'  return (m_{varName} != nullptr) ? m_{varName}->getNameId() : BadSymbolId;')
+        content.append( '}')
+        content.append( '')
         content.append(f'bool {ClassName}::setName(std::string_view name) {{')
+        content.append( '  materialize();')
         content.append( '  if (m_name == nullptr) {')
         content.append( '    m_name = m_serializer->make<Identifier>();')
         content.append( '    m_name->setParent(this);')
+        content.append( '    touch();')
         content.append( '  }')
         content.append( '  m_name->setName(name);')
         content.append( '  return true;')
@@ -278,7 +289,8 @@ def _get_implementations(classname, name, type, vpi, card):
                 content.append(f'  if (!m_{varName}) {{')
                 content.append( '    const std::string fullName = computeFullName();')
                 content.append( '    if (!fullName.empty()) {')
-                content.append(f'      const_cast<{ClassName}*>(this)->setFullName(fullName);')
+                content.append( '      // Only cached, the object isn\'t flagged as modified.')
+                content.append(f'      const_cast<{ClassName}*>(this)->m_{varName} = m_serializer->makeSymbol(fullName);')
                 content.append( '    }')
                 content.append( '  }')
                 content.append(f'  return m_{varName} ? m_serializer->getSymbol(m_{varName}) : kEmpty;')
@@ -291,6 +303,7 @@ def _get_implementations(classname, name, type, vpi, card):
             content.append('')
             content.append(f'bool {ClassName}::set{FuncName}(std::string_view data) {{')
             content.append(f'  m_{varName} = m_serializer->makeSymbol(data);')
+            content.append(f'  touch();')
             content.append(f'  return true;')
             content.append(f'}}')
 
@@ -306,7 +319,10 @@ def _get_implementations(classname, name, type, vpi, card):
 
     elif card == 'any':
         content.append(f'{TypeName}Collection* {ClassName}::get{FuncName}(bool createIfNull) {{')
+        content.append( '  materialize();')
         content.append(f'  if (m_{varName} == nullptr) m_{varName} = m_serializer->makeCollection<{TypeName}>();')
+        content.append( '  // The caller is about to fill it.')
+        content.append( '  touch();')
         content.append(f'  return m_{varName};')
         content.append( '}')
 
@@ -556,8 +572,9 @@ def _get_getByVpiName_implementation(model):
 
     includes = set()
     content = []
-    content.append(f'const BaseClass* {ClassName}::getByVpiName(std::string_view name) const {{')
+    content.append(f'const BaseClass* {ClassName}::findByVpiName(SymbolId nameId, std::string_view name) const {{')
 
+    materialized = False
     for key, value in model.allitems():
         if key in ['class', 'obj_ref', 'class_ref', 'group_ref']:
             name = value.get('name')
@@ -565,18 +582,22 @@ def _get_getByVpiName_implementation(model):
 
             varName = config.make_var_name(name, card)
 
+            if not materialized:
+                materialized = True
+                content.append('  materialize();')
+
             if card == '1':
-                content.append(f'  if ((m_{varName} != nullptr) && (m_{varName}->getName().compare(name) == 0)) return m_{varName};')
+                content.append(f'  if ((m_{varName} != nullptr) && isNamed(m_{varName}, nameId, name)) return m_{varName};')
             else:
                 type = value.get('type')
                 if key != 'group_ref' and type != 'symbol':
                     includes.add(type)
 
                 content.append(f'  if (m_{varName} != nullptr) {{')
-                content.append(f'    for (const BaseClass *ref : *m_{varName}) if (ref->getName().compare(name) == 0) return ref;')
+                content.append(f'    for (const BaseClass *ref : *m_{varName}) if (isNamed(ref, nameId, name)) return ref;')
                 content.append( '  }')
 
-    content.append(f'  return basetype_t::getByVpiName(name);')
+    content.append(f'  return basetype_t::findByVpiName(nameId, name);')
     content.append( '}')
     content.append( '')
 
@@ -610,6 +631,9 @@ def _get_getByVpiType_implementation(model, models):
     content = []
     content.append(f'{ClassName}::get_by_vpi_type_return_t {ClassName}::getByVpiType(int32_t type) const {{')
 
+    if case_bodies:
+        content.append('  materialize();')
+
     if (modeltype == 'obj_def') or case_bodies:
         content.append('  switch (type) {')
 
@@ -777,6 +801,11 @@ def _get_swap_implementation(model):
          ''
     ]
 
+    content_refs = [
+        f'void {ClassName}::collectReferences(std::vector<const BaseClass*>& references) const {{',
+         '  basetype_t::collectReferences(references);'
+    ]
+
     for key, value in model.allitems():
         if key not in ['property', 'obj_ref', 'class_ref', 'class', 'group_ref']:
             continue
@@ -802,29 +831,64 @@ def _get_swap_implementation(model):
                 content_one.append(f'  if (m_{varName} == what) {{')
                 content_one.append(f'    if (with == nullptr) m_{varName} = nullptr;')
                 content_one.append(f'    else if ({TypeName}* const withT = with->Cast<{TypeName}>()) m_{varName} = withT;')
+                content_one.append( '    touch();')
                 content_one.append( '  }')
 
                 content_many.append(f'  if (m_{varName} != nullptr) {{')
                 content_many.append(f'    if (auto it = replacements.find(m_{varName}); it != replacements.cend()) {{')
                 content_many.append(f'      if (it->second == nullptr) m_{varName} = nullptr;')
                 content_many.append(f'      else if ({TypeName}* const withT = it->second->Cast<{TypeName}>()) m_{varName} = withT;')
+                content_many.append( '      touch();')
                 content_many.append( '    }')
                 content_many.append( '  }')
+
+                content_refs.append(f'  if (m_{varName} != nullptr) references.emplace_back(m_{varName});')
         else:
             if type not in ['any', 'symbol']:
                 includes.add(type)
 
-            content_one.append(f'  if (m_{varName} != nullptr) swapT(*m_{varName}, what, with);')
+            content_one.append(f'  if ((m_{varName} != nullptr) && swapT(*m_{varName}, what, with)) touch();')
 
-            content_many.append(f'  if (m_{varName} != nullptr) swapT(*m_{varName}, replacements);')
+            content_many.append(f'  if ((m_{varName} != nullptr) && swapT(*m_{varName}, replacements)) touch();')
+
+            content_refs.append(f'  if (m_{varName} != nullptr) references.insert(references.end(), m_{varName}->cbegin(), m_{varName}->cend());')
 
     content_one.append('}')
     content_many.append('}')
+    content_refs.append('}')
 
-    content = content_one + [''] + content_many + ['']
+    content = content_one + [''] + content_many + [''] + content_refs + ['']
     return content, includes
 
 
+def _get_collectSymbols_implementation(model):
+    classname = model['name']
+    ClassName = config.make_class_name(classname)
+
+    content = [
+        f'void {ClassName}::collectSymbols(std::vector<SymbolId>& symbols) const {{',
+         '  basetype_t::collectSymbols(symbols);'
+    ]
+
+    for key, value in model.allitems():
+        if key != 'property':
+            continue
+
+        name = value.get('name')
+        type = value.get('type')
+        card = value.get('card')
+
+        if (name == 'type') or (card != '1') or (type not in ['string', 'symbol', 'value', 'delay']):
+            continue
+
+        varName = config.make_var_name(name, card)
+        content.append(f'  if (m_{varName}) symbols.emplace_back(m_{varName});')
+
+    content.append('}')
+    content.append('')
+    return content
+
+
 _cached_members = {}
 def _get_group_members_recursively(model, models):
     global _cached_members
@@ -1028,10 +1092,10 @@ def _generate_one_class(model, models, templates):
         return_type = 'TFCall' if ClassName.endswith('Call') else ClassName
         public_declarations.append(f'  {return_type}* deepClone(BaseClass* parent, CloneContext* context) const {override};')
 
-    public_declarations.append(f'  const BaseClass* getByVpiName(std::string_view name) const {override};')
     public_declarations.append(f'  get_by_vpi_type_return_t getByVpiType(int32_t type) const {override};')
     public_declarations.append(f'  vpi_property_value_t getVpiPropertyValue(int32_t property) const {override};')
     public_declarations.append(f'  int32_t compare(const BaseClass* other, UhdmComparer* comparer) const {override};')
+    public_declarations.append(f'  void collectReferences(std::vector<const BaseClass*>& references) const {override};')
     public_declarations.append(f'  void swap(const BaseClass* what, BaseClass* with) {override};')
     public_declarations.append(f'  void swap(const std::map<const BaseClass*, BaseClass*>& replacements) {override};')
 
@@ -1059,6 +1123,10 @@ def _generate_one_class(model, models, templates):
     implementations.extend(func_body)
     includes.update(func_includes)
 
+    private_declarations.append(f'  const BaseClass* findByVpiName(SymbolId nameId, std::string_view name) const {override};')
+    private_declarations.append(f'  void collectSymbols(std::vector<SymbolId>& symbols) const {override};')
+    implementations.extend(_get_collectSymbols_implementation(model))
+
     if ClassName in _collector_class_types:
         private_declarations.append('  void onChildAdded(BaseClass* child) override;')
         private_declarations.append('  void onChildRemoved(BaseClass* child) override;')
@@ -7,12 +7,16 @@ import uhdm_types_h
 
 def generate(models):
     save_ids = []
-    save_objects = []
+    save_dispatch = []
+    save_prepare = []
     saves_adapters = []
 
     restore_ids = []
-    restore_objects = []
+    restore_dispatch = []
+    restore_types = []
+    restore_kind_of = []
     restore_adapters = []
+    restore_relations = []
 
     type_map = uhdm_types_h.get_type_map(models)
 
@@ -30,16 +34,30 @@ def generate(models):
 
         if modeltype != 'class_def':
             save_ids.append(f'  m_{varName}Factory.mapToIndex(idMap);')
-            save_objects.append(f'  adapter.template operator()<{ClassName}, ::{ClassName}>(this, idMap, cap_root.initFactory{ClassName}(m_factories[UhdmType::{ClassName}]->m_objects.size()));')
+            save_dispatch.append(f'    case UhdmType::{ClassName}: visitor(static_cast<{ClassName}*>(nullptr), [](UhdmRoot::Builder cap_root, uint32_t n) {{ return cap_root.initFactory{ClassName}(n); }}); break;')
 
-            restore_ids.append(f'  make<{ClassName}>(cap_root.getFactory{ClassName}().size());')
-            restore_objects.append(f'  adapter.template operator()<{ClassName}, ::{ClassName}>(cap_root.getFactory{ClassName}(), this);')
+            restore_ids.append(f'  serializer->make<{ClassName}>(getCount(UhdmType::{ClassName}));')
+            restore_dispatch.append(f'    case UhdmType::{ClassName}: visitor(static_cast<{ClassName}*>(nullptr), [](UhdmRoot::Reader cap_root) {{ return cap_root.getFactory{ClassName}(); }}); break;')
+            restore_types.append(f'  UhdmType::{ClassName},')
 
-        saves_adapters.append(f'  void operator()(const {ClassName} *const obj, Serializer *const serializer, const Serializer::IdMap &idMap, ::{ClassName}::Builder builder) const {{')
-        saves_adapters.append(f'    operator()(static_cast<const {BaseName}*>(obj), serializer, idMap, builder.getBase());')
+            kinds = [f'(base == UhdmType::{ClassName})']
+            extended = model.get('extends')
+            while extended:
+                kinds.append(f'(base == UhdmType::{config.make_class_name(extended)})')
+                extended = models[extended].get('extends')
+            restore_kind_of.append(f'    case UhdmType::{ClassName}: return {" || ".join(kinds)};')
 
-        restore_adapters.append(f'  void operator()(::{ClassName}::Reader reader, Serializer *const serializer, {ClassName} *const obj) const {{')
-        restore_adapters.append(f'    operator()(reader.getBase(), serializer, static_cast<{BaseName}*>(obj));')
+        save_prepare.append(f'  void prepare(const {ClassName} *const obj) const {{')
+        save_prepare.append(f'    prepare(static_cast<const {BaseName}*>(obj));')
+
+        saves_adapters.append(f'  void operator()(const {ClassName} *const obj, Serializer *const serializer, ::{ClassName}::Builder builder) const {{')
+        saves_adapters.append(f'    operator()(static_cast<const {BaseName}*>(obj), serializer, builder.getBase());')
+
+        restore_adapters.append(f'  void restoreProperties(::{ClassName}::Reader reader, Serializer *const serializer, {ClassName} *const obj) const {{')
+        restore_adapters.append(f'    restoreProperties(reader.getBase(), serializer, static_cast<{BaseName}*>(obj));')
+
+        restore_relations.append(f'  void restoreRelations(::{ClassName}::Reader reader, Serializer *const serializer, {ClassName} *const obj) const {{')
+        restore_relations.append(f'    restoreRelations(reader.getBase(), serializer, static_cast<{BaseName}*>(obj));')
 
         for key, value in model.allitems():
             if key == 'property':
@@ -53,9 +71,12 @@ def generate(models):
 
                 FuncName = config.make_func_name(name, card)
 
+                if vpi == 'vpiFullName':
+                    save_prepare.append(f'    obj->get{FuncName}();')
+
                 if type in ['string', 'value', 'delay']:
-                    saves_adapters.append(f'    builder.set{FuncName}((RawSymbolId)serializer->m_symbolFactory.registerSymbol(obj->get{FuncName}()));')
-                    restore_adapters.append(f'    obj->set{FuncName}(serializer->m_symbolFactory.getSymbol(SymbolId(reader.get{FuncName}(), kUnknownRawSymbol)));')
+                    saves_adapters.append(f'    builder.set{FuncName}(getSymbolId(obj->m_{config.make_var_name(name, card)}));')
+                    restore_adapters.append(f'    obj->m_{config.make_var_name(name, card)} = getSymbolId(serializer, reader.get{FuncName}());')
                 else:
                     saves_adapters.append(f'    builder.set{FuncName}(obj->get{FuncName}());')
                     restore_adapters.append(f'    obj->set{FuncName}(reader.get{FuncName}());')
@@ -77,18 +98,18 @@ def generate(models):
                     if key in ['class_ref', 'group_ref']:
                         saves_adapters.append(f'    if (auto p = obj->get{FuncName}()) {{')
                         saves_adapters.append(f'      ::ObjIndexType::Builder tmp = builder.get{FuncName}();')
-                        saves_adapters.append( '      tmp.setIndex(getId(p, idMap));')
+                        saves_adapters.append( '      tmp.setIndex(getId(p));')
                         saves_adapters.append(f'      tmp.setType(static_cast<uint32_t>(p->getUhdmType()));')
                         saves_adapters.append( '    }')
 
-                        restore_adapters.append(f'    obj->set{FuncName}(serializer->getObject<{TypeName}>(reader.get{FuncName}().getType(), reader.get{FuncName}().getIndex() - 1));')
+                        restore_relations.append(f'    obj->set{FuncName}(getObject<{TypeName}>(serializer, reader.get{FuncName}().getType(), reader.get{FuncName}().getIndex() - 1));')
                     else:
                         suffix = 'Obj 'if vpi in ['vpiName'] else ''
-                        saves_adapters.append(f'    if (auto p = obj->get{FuncName}{suffix}()) builder.set{FuncName}(getId(p, idMap));')
+                        saves_adapters.append(f'    if (auto p = obj->get{FuncName}{suffix}()) builder.set{FuncName}(getId(p));')
 
-                        restore_adapters.append(f'    if (reader.get{FuncName}()) {{')
-                        restore_adapters.append(f'      obj->set{FuncName}{suffix}(serializer->getObject<{TypeName}>(static_cast<uint32_t>(UhdmType::{TypeName}), reader.get{FuncName}() - 1));')
-                        restore_adapters.append( '    }')
+                        restore_relations.append(f'    if (reader.get{FuncName}()) {{')
+                        restore_relations.append(f'      obj->set{FuncName}{suffix}(getObject<{TypeName}>(serializer, static_cast<uint32_t>(UhdmType::{TypeName}), reader.get{FuncName}() - 1));')
+                        restore_relations.append( '    }')
 
                 else:
                     obj_key = '::ObjIndexType' if key in ['class_ref', 'group_ref'] else '::uint64_t'
@@ -97,35 +118,41 @@ def generate(models):
                     saves_adapters.append(f'      ::capnp::List<{obj_key}>::Builder {varName}Builder = builder.init{FuncName}(v->size());')
                     saves_adapters.append( '      for (int32_t i = 0, n = v->size(); i < n; ++i) {')
 
-                    restore_adapters.append(f'    if (uint32_t n = reader.get{FuncName}().size()) {{')
-                    restore_adapters.append(f'      std::vector<{TypeName}*> *const v = serializer->makeCollection<{TypeName}>();')
-                    restore_adapters.append( '      v->reserve(n);')
-                    restore_adapters.append( '      for (uint32_t i = 0; i < n; ++i) {')
+                    restore_relations.append(f'    if (uint32_t n = reader.get{FuncName}().size()) {{')
+                    restore_relations.append(f'      std::vector<{TypeName}*> *const v = makeCollection<{TypeName}>(serializer);')
+                    restore_relations.append( '      v->reserve(n);')
+                    restore_relations.append( '      for (uint32_t i = 0; i < n; ++i) {')
 
                     if key in ['class_ref', 'group_ref']:
                         saves_adapters.append(f'        ::ObjIndexType::Builder tmp = {varName}Builder[i];')
-                        saves_adapters.append( '        tmp.setIndex(getId((*v)[i], idMap));')
+                        saves_adapters.append( '        tmp.setIndex(getId((*v)[i]));')
                         saves_adapters.append( '        tmp.setType(static_cast<uint32_t>(((*v)[i])->getUhdmType()));')
 
-                        restore_adapters.append(f'        v->emplace_back(serializer->getObject<{TypeName}>(reader.get{FuncName}()[i].getType(), reader.get{FuncName}()[i].getIndex() - 1));')
+                        restore_relations.append(f'        v->emplace_back(getObject<{TypeName}>(serializer, reader.get{FuncName}()[i].getType(), reader.get{FuncName}()[i].getIndex() - 1));')
                     else:
-                        saves_adapters.append(f'        {varName}Builder.set(i, getId((*v)[i], idMap));')
+                        saves_adapters.append(f'        {varName}Builder.set(i, getId((*v)[i]));')
 
-                        restore_adapters.append(f'        v->emplace_back(serializer->getObject<{TypeName}>(static_cast<uint32_t>(UhdmType::{TypeName}), reader.get{FuncName}()[i] - 1));')
+                        restore_relations.append(f'        v->emplace_back(getObject<{TypeName}>(serializer, static_cast<uint32_t>(UhdmType::{TypeName}), reader.get{FuncName}()[i] - 1));')
 
                     saves_adapters.append('      }')
                     saves_adapters.append('    }')
 
-                    restore_adapters.append( '      }')
-                    restore_adapters.append(f'      obj->set{FuncName}(v);')
-                    restore_adapters.append( '    }')
+                    restore_relations.append( '      }')
+                    restore_relations.append(f'      obj->set{FuncName}(v);')
+                    restore_relations.append( '    }')
 
         saves_adapters.append('  }')
         saves_adapters.append('')
 
+        save_prepare.append('  }')
+        save_prepare.append('')
+
         restore_adapters.append('  }')
         restore_adapters.append('')
 
+        restore_relations.append('  }')
+        restore_relations.append('')
+
     uhdm_name_map = [ f'    case UhdmType::{name} /* = {id} */: return "{name}";' for name, id in type_map.items() if name != 'BaseClass' ]
     init_factories = [ f'  m_factories[UhdmType::{name}] = new Factory;' for name in type_map.keys() ]
 
@@ -148,8 +175,8 @@ def generate(models):
     with open(config.get_template_filepath('Serializer_save.cpp'), 'rt') as strm:
         file_content = strm.read()
 
-    file_content = file_content.replace('<CAPNP_SAVE>', '\n'.join(sorted(save_objects)))
-    file_content = file_content.replace('<CAPNP_SAVE_ADAPTERS>', '\n'.join(saves_adapters))
+    file_content = file_content.replace('<CAPNP_SAVE_DISPATCH>', '\n'.join(sorted(save_dispatch)))
+    file_content = file_content.replace('<CAPNP_SAVE_ADAPTERS>', '\n'.join(save_prepare + saves_adapters))
     file_utils.set_content_if_changed(config.get_output_source_filepath('Serializer_save.cpp'), file_content)
 
     # Serializer_restore.cpp
@@ -157,8 +184,10 @@ def generate(models):
         file_content = strm.read()
 
     file_content = file_content.replace('<CAPNP_INIT_FACTORIES>', '\n'.join(sorted(restore_ids)))
-    file_content = file_content.replace('<CAPNP_RESTORE_FACTORIES>', '\n'.join(sorted(restore_objects)))
-    file_content = file_content.replace('<CAPNP_RESTORE_ADAPTERS>', '\n'.join(restore_adapters))
+    file_content = file_content.replace('<CAPNP_RESTORE_DISPATCH>', '\n'.join(sorted(restore_dispatch)))
+    file_content = file_content.replace('<CAPNP_RESTORE_TYPES>', '\n'.join(sorted(restore_types)))
+    file_content = file_content.replace('<CAPNP_RESTORE_KIND_OF>', '\n'.join(sorted(restore_kind_of)))
+    file_content = file_content.replace('<CAPNP_RESTORE_ADAPTERS>', '\n'.join(restore_adapters + restore_relations))
     file_utils.set_content_if_changed(config.get_output_source_filepath('Serializer_restore.cpp'), file_content)
 
     return True
@@ -27,12 +27,60 @@
 #include <uhdm/UhdmComparer.h>
 
 namespace uhdm {
+BaseClass& BaseClass::operator=(const BaseClass& rhs) {
+  if (this == &rhs) return *this;
+  rhs.materialize();
+  RTTI::operator=(rhs);
+  // Client data is kept by the serializer: the entry is dropped from the
+  // current one before moving to the serializer of rhs.
+  setClientData(nullptr);
+  m_serializer = rhs.m_serializer;
+  setClientData(const_cast<ClientData*>(rhs.getClientData()));
+  m_uhdmId = rhs.m_uhdmId;
+  // m_slot is where this object sits in its factory, it isn't copied.
+  m_pendingRestore = false;
+  touch();
+  m_parent = rhs.m_parent;
+  m_fileId = rhs.m_fileId;
+  m_startLine = rhs.m_startLine;
+  m_endLine = rhs.m_endLine;
+  m_startColumn = rhs.m_startColumn;
+  m_endColumn = rhs.m_endColumn;
+  return *this;
+}
+
+ClientData* BaseClass::getClientData() {
+  return m_hasClientData ? m_serializer->m_clientData.at(this) : nullptr;
+}
+
+const ClientData* BaseClass::getClientData() const {
+  return m_hasClientData ? m_serializer->m_clientData.at(this) : nullptr;
+}
+
+void BaseClass::setClientData(ClientData* data) {
+  if (data != nullptr) {
+    m_serializer->m_clientData[this] = data;
+  } else if (m_hasClientData) {
+    m_serializer->m_clientData.erase(this);
+  }
+  m_hasClientData = data != nullptr;
+}
+
+void BaseClass::materializeRelations() const {
+  m_serializer->materialize(const_cast<BaseClass*>(this));
+}
+
+void BaseClass::onTouched() {
+  if (m_serializer != nullptr) m_serializer->onTouched(this);
+}
+
 std::string_view BaseClass::getFile() const {
   return m_fileId ? m_serializer->getSymbol(m_fileId) : kEmpty;
 }
 
 bool BaseClass::setFile(std::string_view data) {
   m_fileId = m_serializer->makeSymbol(data);
+  touch();
   return true;
 }
 
@@ -44,6 +92,7 @@ bool BaseClass::setParent(BaseClass* data, bool force /* = false */) {
     return false;
 
   BaseClass* const oldParent = m_parent;
+  touch();
 
   m_parent = nullptr;
   if (oldParent != nullptr) oldParent->onChildRemoved(this);
@@ -55,6 +104,11 @@ bool BaseClass::setParent(BaseClass* data, bool force /* = false */) {
 }
 
 const BaseClass* BaseClass::getByVpiName(std::string_view name) const {
+  return findByVpiName(m_serializer->getSymbolId(name), name);
+}
+
+const BaseClass* BaseClass::findByVpiName(SymbolId nameId,
+                                          std::string_view name) const {
   return nullptr;
 }
 
@@ -200,6 +254,10 @@ int32_t BaseClass::compare(const BaseClass* const other,
   const thistype_t* const lhs = this;
   const thistype_t* const rhs = other;
 
+  // Derived classes compare their relations after this returns.
+  lhs->materialize();
+  rhs->materialize();
+
   int32_t r = 0;
 
   if ((r = comparer->compare(lhs, getVpiType(), rhs, rhs->getVpiType(), vpiType,
@@ -241,7 +299,10 @@ int32_t BaseClass::compare(const BaseClass* const other,
 void BaseClass::swap(const BaseClass* what, BaseClass* with) {
   // Do NOT call setParent(with) here because it invokes onChildXXX
   // causing edits to containers that are being iterated on the call stack.
-  if (m_parent == what) m_parent = with;
+  if (m_parent == what) {
+    m_parent = with;
+    touch();
+  }
 }
 
 void BaseClass::swap(
@@ -250,7 +311,17 @@ void BaseClass::swap(
   // causing edits to containers that are being iterated on the call stack.
   if (auto it = replacements.find(m_parent); it != replacements.cend()) {
     m_parent = it->second;
+    touch();
   }
 }
 
+void BaseClass::collectReferences(
+    std::vector<const BaseClass*>& references) const {
+  if (m_parent != nullptr) references.emplace_back(m_parent);
+}
+
+void BaseClass::collectSymbols(std::vector<SymbolId>& symbols) const {
+  if (m_fileId) symbols.emplace_back(m_fileId);
+}
+
 }  // namespace uhdm
@@ -0,0 +1,157 @@
+/*
+ Copyright 2019 Alain Dargelas
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+/*
+ * File:   BlockCodec.cpp
+ * Author:
+ *
+ * Created on October 16, 2026
+ */
+
+#include <uhdm/BlockCodec.h>
+
+#include <cstring>
+#include <vector>
+
+namespace uhdm {
+// A sequence starts with a token byte: literal count in the high nibble,
+// match length minus kMinMatch in the low one. A nibble of 15 is followed by
+// extra bytes added to it, up to and including the first one below 255. Then
+// come the literals, and unless the block ends there, the 16-bit little
+// endian offset of the match back from the current output.
+static constexpr uint32_t kMinMatch = 4;
+static constexpr uint32_t kMaxOffset = 0xFFFF;
+static constexpr uint32_t kHashBits = 16;
+static constexpr uint32_t kNoPosition = static_cast<uint32_t>(-1);
+
+static uint32_t read32(const uint8_t* p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t hash(uint32_t value) {
+  return (value * 2654435761U) >> (32 - kHashBits);
+}
+
+static uint8_t* writeLength(uint8_t* out, size_t length) {
+  for (; length >= 255; length -= 255) *out++ = 255;
+  *out++ = static_cast<uint8_t>(length);
+  return out;
+}
+
+static bool readLength(const uint8_t*& in, const uint8_t* end,
+                       size_t* length) {
+  uint8_t byte = 255;
+  while (byte == 255) {
+    if (in == end) return false;
+    byte = *in++;
+    *length += byte;
+  }
+  return true;
+}
+
+static uint8_t* writeSequence(uint8_t* out, const uint8_t* literals,
+                              size_t literalCount, size_t offset,
+                              size_t matchLength) {
+  const size_t extraMatch = (matchLength == 0) ? 0 : matchLength - kMinMatch;
+  uint8_t* const token = out++;
+  *token = static_cast<uint8_t>(((literalCount < 15) ? literalCount : 15) << 4);
+  if (literalCount >= 15) out = writeLength(out, literalCount - 15);
+  if (literalCount > 0) std::memcpy(out, literals, literalCount);
+  out += literalCount;
+  if (matchLength == 0) return out;
+
+  *token |= static_cast<uint8_t>((extraMatch < 15) ? extraMatch : 15);
+  *out++ = static_cast<uint8_t>(offset & 0xFF);
+  *out++ = static_cast<uint8_t>(offset >> 8);
+  if (extraMatch >= 15) out = writeLength(out, extraMatch - 15);
+  return out;
+}
+
+size_t BlockCodec::getMaxCompressedSize(size_t size) {
+  return size + size / 255 + 16;
+}
+
+size_t BlockCodec::compress(const uint8_t* src, size_t size, uint8_t* dst) {
+  std::vector<uint32_t> positions(size_t(1) << kHashBits, kNoPosition);
+  uint8_t* out = dst;
+  size_t anchor = 0;
+  size_t i = 0;
+  while (i + kMinMatch <= size) {
+    const uint32_t value = read32(src + i);
+    uint32_t& entry = positions[hash(value)];
+    const uint32_t candidate = entry;
+    entry = static_cast<uint32_t>(i);
+    if ((candidate == kNoPosition) || (i - candidate > kMaxOffset) ||
+        (read32(src + candidate) != value)) {
+      ++i;
+      continue;
+    }
+
+    size_t length = kMinMatch;
+    while ((i + length < size) && (src[candidate + length] == src[i + length])) {
+      ++length;
+    }
+    out = writeSequence(out, src + anchor, i - anchor, i - candidate, length);
+    i += length;
+    anchor = i;
+  }
+  // The block ends with literals only, possibly none.
+  out = writeSequence(out, src + anchor, size - anchor, 0, 0);
+  return static_cast<size_t>(out - dst);
+}
+
+bool BlockCodec::decompress(const uint8_t* src, size_t size, uint8_t* dst,
+                            size_t dstSize) {
+  const uint8_t* in = src;
+  const uint8_t* const end = src + size;
+  size_t written = 0;
+  while (in != end) {
+    const uint8_t token = *in++;
+    size_t literalCount = token >> 4;
+    if ((literalCount == 15) && !readLength(in, end, &literalCount)) {
+      return false;
+    }
+    if ((static_cast<size_t>(end - in) < literalCount) ||
+        (dstSize - written < literalCount)) {
+      return false;
+    }
+    if (literalCount > 0) std::memcpy(dst + written, in, literalCount);
+    in += literalCount;
+    written += literalCount;
+    if (in == end) break;
+
+    if (end - in < 2) return false;
+    const size_t offset = in[0] | (size_t(in[1]) << 8);
+    in += 2;
+    size_t length = (token & 0xF) + kMinMatch;
+    if ((length == 15 + kMinMatch) && !readLength(in, end, &length)) {
+      return false;
+    }
+    if ((offset == 0) || (offset > written) || (dstSize - written < length)) {
+      return false;
+    }
+    // Matches may overlap the output they produce, copy byte by byte.
+    const uint8_t* from = dst + written - offset;
+    uint8_t* to = dst + written;
+    for (size_t j = 0; j < length; ++j) to[j] = from[j];
+    written += length;
+  }
+  return written == dstSize;
+}
+
+}  // namespace uhdm
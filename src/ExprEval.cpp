@@ -736,6 +736,7 @@ Expr *ExprEval::flattenPatternAssignments(Serializer &s, const Typespec *tps,
       AnyCollection *ops = op->getOperands();
       ops->at(1) = flattenPatternAssignments(s, tps, (Expr *)ops->at(1));
       ops->at(2) = flattenPatternAssignments(s, tps, (Expr *)ops->at(2));
+      op->touch();
       return result;
     }
     if (op->getOpType() != vpiAssignmentPatternOp) {
@@ -4491,21 +4492,13 @@ bool ExprEval::setValueInInstance(
   if (Any *object = getObject(name, inst, scope_exp, muteError)) {
     wordSize = getWordSize(any_cast<Expr>(object), inst, scope_exp);
   }
+  // Edited in place below, got for editing so that the owner is flagged.
   ParamAssignCollection *ParamAssigns = nullptr;
   if (inst && inst->getUhdmType() == UhdmType::GenScopeArray) {
   } else if (inst && inst->getUhdmType() == UhdmType::Design) {
-    ParamAssigns = ((Design *)inst)->getParamAssigns();
-    if (ParamAssigns == nullptr) {
-      ((Design *)inst)->setParamAssigns(s.makeCollection<ParamAssign>());
-      ParamAssigns = ((Design *)inst)->getParamAssigns();
-    }
+    ParamAssigns = ((Design *)inst)->getParamAssigns(true);
   } else if (const Scope *spe = any_cast<Scope>(inst)) {
-    ParamAssigns = spe->getParamAssigns();
-    if (ParamAssigns == nullptr) {
-      const_cast<Scope *>(spe)->setParamAssigns(
-          s.makeCollection<ParamAssign>());
-      ParamAssigns = spe->getParamAssigns();
-    }
+    ParamAssigns = const_cast<Scope *>(spe)->getParamAssigns(true);
   }
   if (invalidValueI && invalidValueD) {
     if (ParamAssigns) {
@@ -4721,6 +4714,7 @@ bool ExprEval::setValueInInstance(
               ExprCollection *values = array->getExprs();
               values->resize(index + 1);
               (*values)[index] = rhsexp;
+              array->touch();
               return false;
             }
           }
@@ -23,19 +23,182 @@
 
 #include <uhdm/SymbolFactory.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <new>
 
 namespace uhdm {
 
+// Segment of the given own id, and its offset in there.
+static std::pair<uint32_t, size_t> locate(RawSymbolId rid,
+                                          uint32_t firstSegmentBits) {
+  const uint64_t value = uint64_t(rid) + (uint64_t(1) << firstSegmentBits);
+  uint32_t bits = 0;  // floor(log2(value))
+  for (uint32_t step = 32; step > 0; step >>= 1) {
+    if ((value >> (bits + step)) != 0) bits += step;
+  }
+  return {bits - firstSegmentBits, value - (uint64_t(1) << bits)};
+}
+
 SymbolFactory::SymbolFactory() : m_parent(nullptr), m_idOffset(0) {
   registerSymbol(getBadSymbol());
 }
 
+SymbolFactory::~SymbolFactory() {
+  for (std::atomic<const Entry**>& segment : m_segments) {
+    delete[] segment.load();
+  }
+}
+
 std::string_view SymbolFactory::getEmptyMacroMarker() {
   static constexpr std::string_view k_emptyMacroMarker("@@EMPTY_MACRO@@");
   return k_emptyMacroMarker;
 }
 
+void SymbolFactory::Table::place(size_t h, RawSymbolId slot) {
+  size_t i = h & m_mask;
+  while (m_slots[i].load(std::memory_order_relaxed) != 0) i = (i + 1) & m_mask;
+  m_slots[i].store(slot, std::memory_order_release);
+}
+
+const SymbolFactory::Entry* SymbolFactory::getOwnEntry(RawSymbolId rid) const {
+  const auto [segment, offset] = locate(rid, kFirstSegmentBits);
+  const Entry** const entries =
+      m_segments[segment].load(std::memory_order_acquire);
+  return (entries == nullptr) ? nullptr : entries[offset];
+}
+
+std::string_view SymbolFactory::getOwnSymbol(RawSymbolId rid) const {
+  const Entry* const entry = getOwnEntry(rid);
+  return (entry == nullptr) ? getBadSymbol() : entry->getText();
+}
+
+void SymbolFactory::setOwnEntry(RawSymbolId rid, const Entry* entry) {
+  const auto [segment, offset] = locate(rid, kFirstSegmentBits);
+  const Entry** entries = m_segments[segment].load(std::memory_order_acquire);
+  if (entries == nullptr) {
+    // Threads adding to different shards may race for a new segment.
+    const Entry** const allocated =
+        new const Entry*[size_t(1) << (kFirstSegmentBits + segment)]();
+    if (m_segments[segment].compare_exchange_strong(
+            entries, allocated, std::memory_order_acq_rel)) {
+      entries = allocated;
+    } else {
+      delete[] allocated;
+    }
+  }
+  entries[offset] = entry;
+}
+
+RawSymbolId SymbolFactory::find(const Shard& shard, size_t h,
+                                std::string_view symbol) const {
+  const Table* const table = shard.m_table.load(std::memory_order_acquire);
+  if (table == nullptr) return 0;
+  // Tables are never full, the probe ends on an empty slot.
+  for (size_t i = (h / kShardCount) & table->m_mask;;
+       i = (i + 1) & table->m_mask) {
+    const RawSymbolId slot = table->m_slots[i].load(std::memory_order_acquire);
+    if (slot == 0) return 0;
+    const Entry* const entry = getOwnEntry(slot - 1);
+    if ((entry->m_hash == h) && (entry->getText() == symbol)) return slot;
+  }
+}
+
+size_t SymbolFactory::getEntrySize(std::string_view symbol) {
+  // Terminated like a std::string, for callers that want a C string, and
+  // padded so the next entry is aligned.
+  return (sizeof(Entry) + symbol.size() + alignof(Entry)) &
+         ~(alignof(Entry) - 1);
+}
+
+const SymbolFactory::Entry* SymbolFactory::writeEntry(char* storage, size_t h,
+                                                      std::string_view symbol) {
+  Entry* const entry =
+      new (storage) Entry{h, static_cast<uint32_t>(symbol.size())};
+  char* const text = reinterpret_cast<char*>(entry + 1);
+  if (!symbol.empty()) std::memcpy(text, symbol.data(), symbol.size());
+  text[symbol.size()] = '\0';
+  return entry;
+}
+
+const SymbolFactory::Entry* SymbolFactory::store(Shard& shard, size_t h,
+                                                 std::string_view symbol) {
+  const size_t size = getEntrySize(symbol);
+  if (size > shard.m_chunkLeft) {
+    const size_t chunkSize =
+        std::max(size, std::clamp(shard.m_chunkSize, kMinArenaChunkSize,
+                                  kMaxArenaChunkSize));
+    shard.m_chunks.emplace_back(new char[chunkSize]);
+    shard.m_chunkNext = shard.m_chunks.back().get();
+    shard.m_chunkLeft = chunkSize;
+    shard.m_chunkSize += chunkSize;
+  }
+  const Entry* const entry = writeEntry(shard.m_chunkNext, h, symbol);
+  shard.m_chunkNext += size;
+  shard.m_chunkLeft -= size;
+  return entry;
+}
+
+void SymbolFactory::insert(Shard& shard, size_t h, RawSymbolId rid) {
+  Table* table = shard.m_table.load(std::memory_order_relaxed);
+  if ((table == nullptr) || (2 * (shard.m_count + 1) > table->m_mask + 1)) {
+    // Readers go on probing the current table until the new one is complete.
+    const size_t capacity = (table == nullptr) ? 64 : 2 * (table->m_mask + 1);
+    std::unique_ptr<Table> grown = std::make_unique<Table>(capacity);
+    if (table != nullptr) {
+      for (size_t i = 0; i <= table->m_mask; ++i) {
+        const RawSymbolId slot =
+            table->m_slots[i].load(std::memory_order_relaxed);
+        if (slot != 0) {
+          grown->place(getOwnEntry(slot - 1)->m_hash / kShardCount, slot);
+        }
+      }
+    }
+    table = grown.get();
+    shard.m_tables.emplace_back(std::move(grown));
+    shard.m_table.store(table, std::memory_order_release);
+  }
+  table->place(h / kShardCount, rid + 1);
+  ++shard.m_count;
+}
+
+void SymbolFactory::appendUnique(const std::string_view* symbols,
+                                 size_t count) {
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i) size += getEntrySize(symbols[i]);
+  if (size == 0) return;
+
+  // A chunk of its own, out of the way of the bump allocation of the shard.
+  Shard& shard = m_shards.front();
+  char* next = shard.m_chunks.emplace_back(new char[size]).get();
+  shard.m_chunkSize += size;
+  if (!m_unindexed.load(std::memory_order_relaxed)) {
+    m_unindexedFrom = getSymbolCount();
+  }
+  for (size_t i = 0; i < count; ++i) {
+    // Hashed by index().
+    setOwnEntry(m_idCounter++, writeEntry(next, 0, symbols[i]));
+    next += getEntrySize(symbols[i]);
+  }
+  m_unindexed.store(true, std::memory_order_release);
+}
+
+void SymbolFactory::index() {
+  if (!m_unindexed.load(std::memory_order_acquire)) return;
+  std::lock_guard<std::mutex> indexLock(m_indexMutex);
+  if (!m_unindexed.load(std::memory_order_relaxed)) return;
+  for (RawSymbolId rid = m_unindexedFrom, n = getSymbolCount(); rid < n;
+       ++rid) {
+    Entry* const entry = const_cast<Entry*>(getOwnEntry(rid));
+    entry->m_hash = hash(entry->getText());
+    Shard& shard = m_shards[entry->m_hash % kShardCount];
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+    insert(shard, entry->m_hash, rid);
+  }
+  m_unindexed.store(false, std::memory_order_release);
+}
+
 std::pair<SymbolId, std::string_view> SymbolFactory::add(
     std::string_view symbol) {
   if (m_parent) {
@@ -46,23 +209,26 @@ std::pair<SymbolId, std::string_view> SymbolFactory::add(
     }
   }
 
-  auto found = m_symbol2IdMap.find(symbol);
-  if (found != m_symbol2IdMap.end()) {
-    // Do NOT use m_id2SymbolMap[found->second] to build the returned pair.
-    // MS cl compiler seems to have some bug that ends up actually creating
-    // the string_view from a clone of the string and thus invalid by the time
-    // the caller of this function receives it. Use the already pinned
-    // string_view from the map instead.
-    return {SymbolId(found->second + m_idOffset, found->first), found->first};
+  index();
+  const size_t h = hash(symbol);
+  Shard& shard = m_shards[h % kShardCount];
+  RawSymbolId found = find(shard, h, symbol);
+  if (found == 0) {
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+    // Another thread may have added it meanwhile.
+    found = find(shard, h, symbol);
+    if (found == 0) {
+      const Entry* const entry = store(shard, h, symbol);
+      const RawSymbolId rid =
+          m_idCounter.fetch_add(1, std::memory_order_acq_rel);
+      setOwnEntry(rid, entry);
+      insert(shard, h, rid);
+      const std::string_view normalized = entry->getText();
+      return {SymbolId(rid + m_idOffset, normalized), normalized};
+    }
   }
-  const std::string& normalized = m_id2SymbolMap.emplace_back(symbol);
-  const auto inserted = m_symbol2IdMap.insert({normalized, m_idCounter});
-  assert(inserted.second);  // This new insert must succeed.
-  m_idCounter++;
-  // Read the comment above about using the string from m_id2SymbolMap
-  // to build the returned pair.
-  return {SymbolId(inserted.first->second + m_idOffset, inserted.first->first),
-          inserted.first->first};
+  const std::string_view normalized = getOwnSymbol(found - 1);
+  return {SymbolId(found - 1 + m_idOffset, normalized), normalized};
 }
 
 std::pair<SymbolId, std::string_view> SymbolFactory::get(
@@ -74,25 +240,26 @@ std::pair<SymbolId, std::string_view> SymbolFactory::get(
     }
   }
 
-  // Read the comment in SymbolFactory::add above about using the
-  // string from m_id2SymbolMap to build the returned pair.
-  auto found = m_symbol2IdMap.find(symbol);
-  return (found == m_symbol2IdMap.end())
-             ? std::make_pair(getBadId(), getBadSymbol())
-             : std::make_pair(
-                   SymbolId(found->second + m_idOffset, found->first),
-                   found->first);
+  const_cast<SymbolFactory*>(this)->index();
+  const size_t h = hash(symbol);
+  const RawSymbolId found = find(m_shards[h % kShardCount], h, symbol);
+  if (found == 0) return std::make_pair(getBadId(), getBadSymbol());
+  const std::string_view normalized = getOwnSymbol(found - 1);
+  return std::make_pair(SymbolId(found - 1 + m_idOffset, normalized),
+                        normalized);
 }
 
 std::string_view SymbolFactory::getSymbol(SymbolId id) const {
   RawSymbolId rid = (RawSymbolId)id;
-  if (rid < m_idOffset) {
-    assert(m_parent);  // If we have a non-0 idOffset, we must have parent
-    return m_parent->getSymbol(id);
+  const SymbolFactory* table = this;
+  while (rid < table->m_idOffset) {
+    // If we have a non-0 idOffset, we must have parent
+    table = table->m_parent;
+    assert(table);
   }
-  rid -= m_idOffset;
-  if (rid >= m_id2SymbolMap.size()) return getBadSymbol();
-  return m_id2SymbolMap[rid];
+  rid -= table->m_idOffset;
+  if (rid >= table->getSymbolCount()) return getBadSymbol();
+  return table->getOwnSymbol(rid);
 }
 
 SymbolId SymbolFactory::copyFrom(SymbolId id, const SymbolFactory* rhs) {
@@ -104,23 +271,52 @@ void SymbolFactory::appendSymbols(int64_t up_to,
   if (m_parent) m_parent->appendSymbols(m_idOffset, dest);
   up_to -= m_idOffset;
   assert(up_to >= 0);
-  for (const auto& s : m_id2SymbolMap) {
-    if (up_to-- <= 0) return;
-    dest->push_back(s);
+  const RawSymbolId count = getSymbolCount();
+  for (RawSymbolId rid = 0; (rid < count) && (up_to-- > 0); ++rid) {
+    dest->push_back(getOwnSymbol(rid));
   }
 }
 
 std::vector<std::string_view> SymbolFactory::getSymbols() const {
   std::vector<std::string_view> result;
-  result.reserve(m_idOffset + m_id2SymbolMap.size());
-  appendSymbols(m_idOffset + m_id2SymbolMap.size(), &result);
+  result.reserve(m_idOffset + getSymbolCount());
+  appendSymbols(m_idOffset + getSymbolCount(), &result);
   return result;
 }
 
+size_t SymbolFactory::getMemoryUsage() const {
+  size_t bytes = sizeof(*this);
+  for (uint32_t segment = 0; segment < kSegmentCount; ++segment) {
+    if (m_segments[segment].load() != nullptr) {
+      bytes += (size_t(1) << (kFirstSegmentBits + segment)) *
+               sizeof(const Entry*);
+    }
+  }
+  for (const Shard& shard : m_shards) {
+    bytes += shard.m_chunkSize;
+    for (const std::unique_ptr<Table>& table : shard.m_tables) {
+      bytes += sizeof(Table) +
+               (table->m_mask + 1) * sizeof(std::atomic<RawSymbolId>);
+    }
+  }
+  return bytes;
+}
+
 void SymbolFactory::purge() {
-  Symbol2IdMap().swap(m_symbol2IdMap);
-  Id2SymbolMap().swap(m_id2SymbolMap);
+  for (Shard& shard : m_shards) {
+    shard.m_table.store(nullptr);
+    shard.m_tables.clear();
+    shard.m_count = 0;
+    shard.m_chunks.clear();
+    shard.m_chunkNext = nullptr;
+    shard.m_chunkLeft = 0;
+    shard.m_chunkSize = 0;
+  }
+  for (std::atomic<const Entry**>& segment : m_segments) {
+    delete[] segment.exchange(nullptr);
+  }
   m_idCounter = 0;
+  m_unindexed = false;
   registerSymbol(getBadSymbol());
 }
 }  // namespace uhdm
@@ -494,6 +494,8 @@ void SynthSubset::leaveForStmt(const ForStmt* object, vpiHandle handle) {
           if (stlist) {
             IfStmt* ifstmt = m_serializer->make<IfStmt>();
             stlist->insert(stlist->begin(), ifstmt);
+            // Edited in place.
+            const_cast<Any*>(stmt)->touch();
             ifstmt->setCondition((Expr*)rhs);
             BreakStmt* brk = m_serializer->make<BreakStmt>();
             ifstmt->setStmt(brk);
@@ -566,6 +568,8 @@ void SynthSubset::leaveForStmt(const ForStmt* object, vpiHandle handle) {
                 break;
               }
             }
+            // Edited in place.
+            const_cast<Any*>(parent)->touch();
           }
           // Construct the case stmt
           RefObj* ref = m_serializer->make<RefObj>();
@@ -678,11 +682,13 @@ void SynthSubset::sensitivityListRewrite(const Always* object,
         AnyCollection* operands_top = cond_op->getOperands();
         AnyCollection* operands_op0 = nullptr;
         AnyCollection* operands_op1 = nullptr;
+        Operation* opFirst = nullptr;
         Any* opLast = nullptr;
         int totalOperands = 0;
         if (operands_top->size() > 1) {
           if (operands_top->at(0)->getUhdmType() == UhdmType::Operation) {
             Operation* op = (Operation*)operands_top->at(0);
+            opFirst = op;
             operands_op0 = op->getOperands();
             totalOperands += operands_op0->size();
           }
@@ -773,7 +779,7 @@ void SynthSubset::sensitivityListRewrite(const Always* object,
                           break;
                         }
                       }
-                      if (!found) mod->getContAssigns()->push_back(ass);
+                      if (!found) mod->getContAssigns(true)->push_back(ass);
                     }
 
                     // Redirect condition to: if (\synlig_tmp ) ...
@@ -788,6 +794,11 @@ void SynthSubset::sensitivityListRewrite(const Always* object,
                     // Redirect 2nd sensitivity list signal to: posedge
                     // \synlig_tmp
                     opL->getOperands()->at(0) = ref;
+
+                    // Operands edited in place above.
+                    opFirst->touch();
+                    const_cast<Operation*>(cond_op)->touch();
+                    opL->touch();
                   }
                 }
               }
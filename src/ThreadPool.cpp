@@ -0,0 +1,122 @@
+/*
+ Copyright 2019 Alain Dargelas
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+/*
+ * File:   ThreadPool.cpp
+ * Author:
+ *
+ * Created on October 16, 2026
+ */
+
+#include <uhdm/ThreadPool.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace uhdm {
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(1U, std::thread::hardware_concurrency());
+  }
+  m_threads.reserve(threadCount);
+  for (uint32_t i = 0; i < threadCount; ++i) {
+    m_threads.emplace_back(&ThreadPool::run, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_taskReady.notify_all();
+  for (std::thread& thread : m_threads) thread.join();
+}
+
+void ThreadPool::submit(task_t task) {
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_tasks.emplace_back(std::move(task));
+  }
+  m_taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_allDone.wait(lock, [this] { return m_tasks.empty() && (m_busy == 0); });
+  if (m_error) {
+    std::exception_ptr error;
+    std::swap(error, m_error);
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadPool::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_taskReady.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+    if (m_tasks.empty()) return;  // Stopping, and nothing left to do.
+
+    task_t task = std::move(m_tasks.front());
+    m_tasks.pop_front();
+    ++m_busy;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+    if (error && !m_error) m_error = error;
+    if ((--m_busy == 0) && m_tasks.empty()) m_allDone.notify_all();
+  }
+}
+
+void ThreadPool::parallelFor(uint32_t threadCount, size_t count,
+                             const std::function<void(size_t)>& fn) {
+  if (threadCount == 0) {
+    threadCount = std::max(1U, std::thread::hardware_concurrency());
+  }
+  if ((threadCount == 1) || (count <= 1)) {
+    for (size_t i = 0; i < count; ++i) fn(i);
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::mutex mutex;
+  std::exception_ptr error;
+  auto worker = [&]() {
+    try {
+      for (size_t i = next++; i < count; i = next++) fn(i);
+    } catch (...) {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (!error) error = std::current_exception();
+      next = count;  // Stop handing out work.
+    }
+  };
+
+  std::vector<std::thread> helpers;
+  const size_t helperCount = std::min<size_t>(threadCount, count) - 1;
+  helpers.reserve(helperCount);
+  for (size_t i = 0; i < helperCount; ++i) helpers.emplace_back(worker);
+  worker();
+  for (std::thread& helper : helpers) helper.join();
+  if (error) std::rethrow_exception(error);
+}
+
+}  // namespace uhdm
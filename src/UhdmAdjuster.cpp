@@ -176,6 +176,7 @@ void UhdmAdjuster::leaveCaseStmt(const CaseStmt* object, vpiHandle handle) {
                                            is_overall_unsigned)) {
             if (newValue->getUhdmType() == UhdmType::Constant) {
               citem->getExprs()->at(i) = newValue;
+              citem->touch();
             }
           }
         }
@@ -244,6 +245,7 @@ void UhdmAdjuster::leaveConstant(const Constant* object, vpiHandle handle) {
             newc->setConstType(vpiUIntConst);
           }
           op->getOperands()->at(indexSelf) = newc;
+          op->touch();
         }
       } else if (parent->getUhdmType() == UhdmType::ContAssign) {
         ContAssign* assign = (ContAssign*)parent;
@@ -311,6 +313,7 @@ void UhdmAdjuster::updateParentWithReducedExpression(const Any* object,
       for (Any* oper : *operands) {
         if (oper == object) {
           operands->at(index) = tmp;
+          poper->touch();
           break;
         }
         index++;
@@ -354,6 +357,7 @@ void UhdmAdjuster::updateParentWithReducedExpression(const Any* object,
       for (Any* oper : *operands) {
         if (oper == object) {
           operands->at(index) = tmp;
+          poper->touch();
           break;
         }
         index++;
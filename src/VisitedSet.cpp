@@ -0,0 +1,154 @@
+/*
+ Copyright 2019 Alain Dargelas
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+/*
+ * File:   VisitedSet.cpp
+ * Author:
+ *
+ * Created on October 16, 2026
+ */
+
+#include <uhdm/VisitedSet.h>
+
+#include <algorithm>
+
+namespace uhdm {
+
+VisitedSet::const_iterator::reference VisitedSet::const_iterator::operator*()
+    const {
+  if (m_index < m_set->getCapacity()) {
+    return m_set->m_pages[m_index >> kPageBits][m_index & kPageMask];
+  }
+  return *m_other;
+}
+
+VisitedSet::const_iterator& VisitedSet::const_iterator::operator++() {
+  if (m_index < m_set->getCapacity()) {
+    ++m_index;
+    skipEmpty();
+  } else {
+    ++m_other;
+  }
+  return *this;
+}
+
+void VisitedSet::const_iterator::skipEmpty() {
+  const size_t capacity = m_set->getCapacity();
+  while (m_index < capacity) {
+    const std::unique_ptr<const Any*[]>& page =
+        m_set->m_pages[m_index >> kPageBits];
+    if (!page) {
+      m_index = (m_index | kPageMask) + 1;
+    } else if (page[m_index & kPageMask] == nullptr) {
+      ++m_index;
+    } else {
+      return;
+    }
+  }
+  m_other = m_set->m_others.begin();
+}
+
+VisitedSet& VisitedSet::operator=(const VisitedSet& other) {
+  if (this == &other) return *this;
+  m_pages.clear();
+  m_pages.resize(other.m_pages.size());
+  for (size_t i = 0, n = other.m_pages.size(); i < n; ++i) {
+    if (const std::unique_ptr<const Any*[]>& page = other.m_pages[i]) {
+      m_pages[i].reset(new const Any*[kPageSize]);
+      std::copy(page.get(), page.get() + kPageSize, m_pages[i].get());
+    }
+  }
+  m_others = other.m_others;
+  m_size = other.m_size;
+  return *this;
+}
+
+std::pair<VisitedSet::const_iterator, bool> VisitedSet::insert(
+    const Any* any) {
+  const uint32_t id = any->getUhdmId();
+  const size_t page = id >> kPageBits;
+  if (page >= m_pages.size()) m_pages.resize(page + 1);
+  if (!m_pages[page]) m_pages[page].reset(new const Any*[kPageSize]());
+
+  const Any*& entry = m_pages[page][id & kPageMask];
+  if (entry == nullptr) {
+    entry = any;
+    ++m_size;
+    return {const_iterator(this, id, m_others.end()), true};
+  }
+  if (entry == any) {
+    return {const_iterator(this, id, m_others.end()), false};
+  }
+
+  // The id is taken by an object of another Serializer.
+  const std::pair<std::set<const Any*>::const_iterator, bool> inserted =
+      m_others.emplace(any);
+  if (inserted.second) ++m_size;
+  return {const_iterator(this, getCapacity(), inserted.first),
+          inserted.second};
+}
+
+VisitedSet::const_iterator VisitedSet::find(const Any* any) const {
+  const uint32_t id = any->getUhdmId();
+  const size_t page = id >> kPageBits;
+  if ((page < m_pages.size()) && m_pages[page]) {
+    const Any* const entry = m_pages[page][id & kPageMask];
+    if (entry == any) return const_iterator(this, id, m_others.end());
+    if (entry == nullptr) return end();
+  }
+  return const_iterator(this, getCapacity(), m_others.find(any));
+}
+
+size_t VisitedSet::erase(const Any* any) {
+  const uint32_t id = any->getUhdmId();
+  const size_t page = id >> kPageBits;
+  if ((page < m_pages.size()) && m_pages[page]) {
+    const Any*& entry = m_pages[page][id & kPageMask];
+    if (entry == any) {
+      // Keep the table exact: an object waiting in the overflow set for this
+      // id takes over the entry.
+      entry = nullptr;
+      for (std::set<const Any*>::const_iterator it = m_others.begin(),
+                                                end = m_others.end();
+           it != end; ++it) {
+        if ((*it)->getUhdmId() == id) {
+          entry = *it;
+          m_others.erase(it);
+          break;
+        }
+      }
+      --m_size;
+      return 1;
+    }
+  }
+  if (m_others.erase(any) == 0) return 0;
+  --m_size;
+  return 1;
+}
+
+void VisitedSet::clear() {
+  m_pages.clear();
+  m_others.clear();
+  m_size = 0;
+}
+
+VisitedSet::const_iterator VisitedSet::begin() const {
+  const_iterator it(this, 0, m_others.end());
+  it.skipEmpty();
+  return it;
+}
+
+}  // namespace uhdm
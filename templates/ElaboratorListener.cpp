@@ -43,11 +43,7 @@ static void propagateParamAssign(ParamAssign* pass, const Any* target) {
       if (AnyCollection* params = defn->getParameters()) {
         for (Any* param : *params) {
           if (param->getName() == name) {
-            ParamAssignCollection* passigns = defn->getParamAssigns();
-            if (passigns == nullptr) {
-              defn->setParamAssigns(s.makeCollection<ParamAssign>());
-              passigns = defn->getParamAssigns();
-            }
+            ParamAssignCollection* passigns = defn->getParamAssigns(true);
             ParamAssign* pa = s.make<ParamAssign>();
             pa->setParent(defn);
             pa->setLhs(param);
@@ -84,11 +80,7 @@ static void propagateParamAssign(ParamAssign* pass, const Any* target) {
       if (AnyCollection* params = defn->getParameters()) {
         for (Any* param : *params) {
           if (param->getName() == name) {
-            ParamAssignCollection* passigns = defn->getParamAssigns();
-            if (passigns == nullptr) {
-              defn->setParamAssigns(s.makeCollection<ParamAssign>());
-              passigns = defn->getParamAssigns();
-            }
+            ParamAssignCollection* passigns = defn->getParamAssigns(true);
             ParamAssign* pa = s.make<ParamAssign>();
             pa->setParent(defn);
             pa->setLhs(param);
@@ -23,6 +23,7 @@
  * Created on October 4, 2021, 10:53 PM
  */
 #include <uhdm/Serializer.h>
+#include <uhdm/ThreadPool.h>
 #include <uhdm/UhdmComparer.h>
 #include <uhdm/UhdmListener.h>
 #include <uhdm/Utils.h>
@@ -30,15 +31,21 @@
 #include <uhdm/vpi_visitor.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace uhdm {
 
-const uint32_t Serializer::kVersion = 1;
+const uint32_t Serializer::kVersion = 2;
+const uint32_t Serializer::kLegacyVersion = 1;
 using replacements_t = std::map<const Any*, Any*>;
 
 Serializer::Serializer() {
@@ -58,7 +65,7 @@ class TypespecUnifier final : public UhdmListener {
 
     using UhdmComparer::compare;
 
-    inline bool isOfPrimitiveType(const Any* any) const {
+    static bool isOfPrimitiveType(const Any* any) {
       return (any->getUhdmType() == UhdmType::BitTypespec) ||
              (any->getUhdmType() == UhdmType::ByteTypespec) ||
              (any->getUhdmType() == UhdmType::IntTypespec) ||
@@ -98,37 +105,61 @@ class TypespecUnifier final : public UhdmListener {
     }
   };
 
+  // Combined from the properties the comparer looks at, and from those of
+  // the objects referred to, down to the given depth, so that equal objects
+  // hash the same.
+  size_t getHash(const Any* any, uint32_t depth) const {
+    size_t h = static_cast<size_t>(any->getUhdmType());
+    auto combine = [&h](size_t value) {
+      h ^= value + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    };
+    combine(static_cast<size_t>(any->getVpiType()));
+    combine(std::hash<std::string_view>()(any->getName()));
+    combine(std::hash<std::string_view>()(any->getDefName()));
+    combine(std::hash<std::string_view>()(any->getFile()));
+    const Typespec* const typespec = getParent<Typespec>(any);
+    if ((typespec == nullptr) || !Comparer::isOfPrimitiveType(typespec)) {
+      combine(any->getStartLine());
+      combine(any->getStartColumn());
+      combine(any->getEndLine());
+      combine(any->getEndColumn());
+    }
+    if (depth > 0) {
+      std::vector<const Any*> references;
+      any->collectReferences(references);
+      // The parent comes first, the comparer doesn't look at it.
+      for (size_t i = (any->getParent() == nullptr) ? 0 : 1;
+           i < references.size(); ++i) {
+        combine(getHash(references[i], depth - 1));
+      }
+    }
+    return h;
+  }
+
+  // Typespecs are bucketed by hash, design wide, and only compared in full
+  // to the kept ones of their bucket. The first of equal typespecs is kept.
   template <typename T>
   void enterTypespecCollection(const std::vector<T*>& container) {
-    if (container.size() < 2) return;
-    typename std::vector<T*> typespecs;
-
-    // Don't remove UnsupportedTypespec(s)
-    std::copy_if(container.cbegin(), container.cend(),
-                 std::back_inserter(typespecs), [](const Any* const any) {
-                   return (any->getUhdmType() != UhdmType::UnsupportedTypespec);
-                 });
-    if (typespecs.size() < 2) return;
-
-    // Sort and find duplicates (keep first and delete others).
-    std::sort(typespecs.begin(), typespecs.end(),
-              [this](const T* const lhs, const T* const rhs) {
-                int32_t r = static_cast<int32_t>(lhs->getUhdmType()) -
-                            static_cast<int32_t>(rhs->getUhdmType());
-                if (r == 0) r = m_comparer.compare(lhs, rhs);
-                if (r == 0) r = lhs->getUhdmId() - rhs->getUhdmId();
-                return r < 0;
-              });
-
-    T* first = const_cast<T*>(typespecs.front());
-    for (size_t i = 1, ni = typespecs.size(); i < ni; ++i) {
-      const T* const any = typespecs[i];
-
-      if ((first != any) && (first->getUhdmType() == any->getUhdmType()) &&
-          (m_comparer.compare(first, any) == 0)) {
-        m_replacements.emplace(any, first);
-      } else {
-        first = const_cast<T*>(any);
+    for (const T* const any : container) {
+      // Don't remove UnsupportedTypespec(s)
+      if ((any->getUhdmType() == UhdmType::UnsupportedTypespec) ||
+          (m_replacements.find(any) != m_replacements.cend())) {
+        continue;
+      }
+
+      std::vector<Any*>& bucket = m_kept[getHash(any, kHashDepth)];
+      const Any* equal = nullptr;
+      for (const Any* const kept : bucket) {
+        if ((kept == any) || ((kept->getUhdmType() == any->getUhdmType()) &&
+                              (m_comparer.compare(kept, any) == 0))) {
+          equal = kept;
+          break;
+        }
+      }
+      if (equal == nullptr) {
+        bucket.emplace_back(const_cast<T*>(any));
+      } else if (equal != any) {
+        m_replacements.emplace(any, const_cast<Any*>(equal));
       }
     }
   }
@@ -325,58 +356,339 @@ class TypespecUnifier final : public UhdmListener {
   }
 
  private:
+  // Deep enough to tell typespecs apart by their ranges.
+  static constexpr uint32_t kHashDepth = 2;
+
   replacements_t m_replacements;
   references_t m_references;
+  std::unordered_map<size_t, std::vector<Any*>> m_kept;
   Comparer m_comparer;
 
   friend class Serializer;
 };
 
-class ReferenceCollector final : public UhdmListener {
+// Marks of the objects of one type, a bit per slot. Bits can be set from
+// several threads at once.
+class MarkBitmap final {
  public:
-  void enterAny(const Any* object, uint32_t relation = 0) final {
-    if (m_callstack.empty() || (m_callstack.back() == object->getParent())) {
-      m_referenced.emplace(object);
+  void resize(size_t count) {
+    m_words = std::vector<std::atomic<uint64_t>>((count + 63) / 64);
+  }
+
+  // Returns false if it was already marked.
+  bool mark(uint32_t slot) {
+    const uint64_t bit = uint64_t(1) << (slot & 63);
+    return (m_words[slot >> 6].fetch_or(bit, std::memory_order_relaxed) &
+            bit) == 0;
+  }
+
+  bool isMarked(uint32_t slot) const {
+    const uint64_t bit = uint64_t(1) << (slot & 63);
+    return (m_words[slot >> 6].load(std::memory_order_relaxed) & bit) != 0;
+  }
+
+ private:
+  std::vector<std::atomic<uint64_t>> m_words;
+};
+
+std::vector<const Any*> Serializer::getReferences(const Any* any) {
+  std::vector<const Any*> references;
+  any->collectReferences(references);
+  std::sort(references.begin(), references.end());
+  references.erase(std::unique(references.begin(), references.end()),
+                   references.end());
+  return references;
+}
+
+void Serializer::indexReferrers() {
+  materializeAll();
+  m_references.clear();
+  m_referrers.clear();
+  m_unindexedObjects.clear();
+  for (factories_t::const_reference entry : m_factories) {
+    for (Any* any : entry.second->getObjects()) {
+      any->m_unindexed = false;
+      std::vector<const Any*> references = getReferences(any);
+      if (references.empty()) continue;
+      for (const Any* reference : references) {
+        m_referrers[reference].emplace_back(any);
+      }
+      m_references.emplace(any, std::move(references));
     }
   }
+  m_indexedReferrers = true;
+}
 
-  replacements_t getReplacements(Factory* const factory) {
-    for (Any* any : factory->getObjects()) listenAny(any);
+void Serializer::clearReferrers() {
+  m_references.clear();
+  m_referrers.clear();
+  m_unindexedObjects.clear();
+  m_indexedReferrers = false;
+  m_collected = false;
+  m_dirtyObjects.clear();
+}
 
-    replacements_t replacements;
-    for (const Any* any : m_visited) {
-      if (m_referenced.find(any) == m_referenced.cend()) {
-        replacements.emplace(any, nullptr);
+void Serializer::onTouched(Any* any) {
+  flagDirty(any);
+  unindex(any);
+}
+
+void Serializer::flagDirty(Any* any) {
+  if (any->m_dirty) return;
+  any->m_dirty = true;
+  if (m_collected) m_dirtyObjects.emplace_back(any);
+}
+
+void Serializer::unindex(Any* any) {
+  if (any->m_unindexed) return;
+  any->m_unindexed = true;
+  if (m_indexedReferrers) m_unindexedObjects.emplace_back(any);
+}
+
+void Serializer::updateReferrers() {
+  std::vector<const Any*> added;
+  std::vector<const Any*> removed;
+  for (Any* any : m_unindexedObjects) {
+    any->m_unindexed = false;
+    std::vector<const Any*> references = getReferences(any);
+    auto it = m_references.find(any);
+    const std::vector<const Any*> none;
+    const std::vector<const Any*>& before =
+        (it == m_references.end()) ? none : it->second;
+    added.clear();
+    std::set_difference(references.cbegin(), references.cend(),
+                        before.cbegin(), before.cend(),
+                        std::back_inserter(added));
+    removed.clear();
+    std::set_difference(before.cbegin(), before.cend(), references.cbegin(),
+                        references.cend(), std::back_inserter(removed));
+
+    for (const Any* reference : added) {
+      m_referrers[reference].emplace_back(any);
+    }
+    for (const Any* reference : removed) {
+      // Dropped by its parent, the child may be garbage now.
+      if (reference->getParent() == any) flagDirty(const_cast<Any*>(reference));
+      if (auto rit = m_referrers.find(reference); rit != m_referrers.end()) {
+        std::vector<Any*>& referrers = rit->second;
+        auto found = std::find(referrers.begin(), referrers.end(), any);
+        if (found != referrers.end()) referrers.erase(found);
+        if (referrers.empty()) m_referrers.erase(rit);
       }
     }
 
-    return replacements;
+    if (references.empty()) {
+      if (it != m_references.end()) m_references.erase(it);
+    } else if (it != m_references.end()) {
+      it->second = std::move(references);
+    } else {
+      m_references.emplace(any, std::move(references));
+    }
   }
+  m_unindexedObjects.clear();
+}
 
- private:
-  AnySet m_referenced;
+bool Serializer::refersTo(const Any* any, const Any* reference) const {
+  auto it = m_references.find(any);
+  return (it != m_references.cend()) &&
+         std::binary_search(it->second.cbegin(), it->second.cend(), reference);
+}
 
-  friend class Serializer;
-};
+template <typename SwapOne>
+void Serializer::swapReferrers(const std::vector<const Any*>& replaced,
+                               SwapOne swapOne) {
+  updateReferrers();
+  std::vector<Any*> referrers;
+  for (const Any* what : replaced) {
+    if (auto it = m_referrers.find(what); it != m_referrers.end()) {
+      referrers.insert(referrers.end(), it->second.cbegin(),
+                       it->second.cend());
+    }
+  }
+  std::sort(referrers.begin(), referrers.end());
+  referrers.erase(std::unique(referrers.begin(), referrers.end()),
+                  referrers.end());
+
+  for (Any* any : referrers) {
+    swapOne(any);
+    unindex(any);
+  }
+  updateReferrers();
+}
+
+void Serializer::unindexReferrers(const std::vector<const Any*>& erased) {
+  if (!m_indexedReferrers || erased.empty()) return;
+  updateReferrers();
+  const AnySet unique(erased.cbegin(), erased.cend());
+  // Each list is filtered once, however many of its objects go.
+  AnySet lists;
+  for (const Any* any : unique) {
+    if (auto it = m_references.find(any); it != m_references.end()) {
+      lists.insert(it->second.cbegin(), it->second.cend());
+    }
+  }
+  for (const Any* reference : lists) {
+    if (auto it = m_referrers.find(reference); it != m_referrers.end()) {
+      std::vector<Any*>& referrers = it->second;
+      referrers.erase(std::remove_if(referrers.begin(), referrers.end(),
+                                     [&unique](const Any* referrer) {
+                                       return unique.find(referrer) !=
+                                              unique.cend();
+                                     }),
+                      referrers.end());
+      if (referrers.empty()) m_referrers.erase(it);
+    }
+  }
+  // The objects still referring to the erased ones forget them too, another
+  // object may be made at the same address.
+  lists.clear();
+  for (const Any* any : unique) {
+    if (auto it = m_referrers.find(any); it != m_referrers.end()) {
+      lists.insert(it->second.cbegin(), it->second.cend());
+    }
+  }
+  for (const Any* referrer : lists) {
+    if (auto it = m_references.find(referrer); it != m_references.end()) {
+      std::vector<const Any*>& references = it->second;
+      references.erase(std::remove_if(references.begin(), references.end(),
+                                      [&unique](const Any* reference) {
+                                        return unique.find(reference) !=
+                                               unique.cend();
+                                      }),
+                       references.end());
+      if (references.empty()) m_references.erase(it);
+    }
+  }
+  for (const Any* any : unique) {
+    m_references.erase(any);
+    m_referrers.erase(any);
+  }
+}
 
 void Serializer::swap(const Any* what, Any* with) {
+  materializeAll();
+  if (m_indexedReferrers) {
+    swapReferrers({what}, [what, with](Any* any) { any->swap(what, with); });
+    return;
+  }
   for (factories_t::const_reference entry : m_factories) {
-    for (Any* any : entry.second->m_objects) {
+    for (Any* any : entry.second->getObjects()) {
       any->swap(what, with);
     }
   }
 }
 
 void Serializer::swap(const std::map<const Any*, Any*>& replacements) {
+  materializeAll();
+  if (m_indexedReferrers) {
+    std::vector<const Any*> replaced;
+    replaced.reserve(replacements.size());
+    for (replacements_t::const_reference entry : replacements) {
+      replaced.emplace_back(entry.first);
+    }
+    swapReferrers(replaced,
+                  [&replacements](Any* any) { any->swap(replacements); });
+    return;
+  }
   for (factories_t::const_reference entry : m_factories) {
-    for (Any* any : entry.second->m_objects) {
+    for (Any* any : entry.second->getObjects()) {
       any->swap(replacements);
     }
   }
 }
 
-void Serializer::collectGarbage() {
-  if (!m_enableGC) return;
+// A MarkBitmap per type, of the objects of all factories.
+struct Serializer::Marks final {
+  explicit Marks(const factories_t& factories)
+      : m_bitmaps(getIndex(factories.rbegin()->first) + 1) {
+    for (factories_t::const_reference entry : factories) {
+      m_bitmaps[getIndex(entry.first)].resize(
+          entry.second->getObjects().size());
+    }
+  }
+
+  static uint32_t getIndex(UhdmType type) {
+    return static_cast<uint32_t>(type) -
+           static_cast<uint32_t>(UhdmType::BaseClass);
+  }
+
+  // Returns false if it was already marked.
+  bool mark(const Any* any) {
+    return m_bitmaps[getIndex(any->getUhdmType())].mark(any->getSlot());
+  }
+
+  bool isMarked(const Any* any) const {
+    return m_bitmaps[getIndex(any->getUhdmType())].isMarked(any->getSlot());
+  }
+
+  // An object is live when its parent is and refers to it, designs are the
+  // roots. Marks the children of parent, queuing the ones not marked yet.
+  void markChildren(const Any* parent, std::vector<const Any*>& references,
+                    std::vector<const Any*>& pending) {
+    references.clear();
+    parent->collectReferences(references);
+    for (const Any* child : references) {
+      if ((child->getParent() == parent) && mark(child)) {
+        pending.emplace_back(child);
+      }
+    }
+  }
+
+  std::vector<MarkBitmap> m_bitmaps;
+};
+
+template <typename IsGarbage>
+void Serializer::sweepGarbage(const std::vector<const Any*>& garbage,
+                              IsGarbage isGarbage) {
+  if (garbage.empty()) return;
+
+  // Live objects drop their references to the garbage. Only its referrers
+  // are visited when indexed.
+  std::vector<Any*> referrers;
+  if (m_indexedReferrers) {
+    updateReferrers();
+    for (const Any* any : garbage) {
+      if (auto it = m_referrers.find(any); it != m_referrers.end()) {
+        for (Any* referrer : it->second) {
+          if (!isGarbage(referrer)) referrers.emplace_back(referrer);
+        }
+      }
+    }
+    std::sort(referrers.begin(), referrers.end());
+    referrers.erase(std::unique(referrers.begin(), referrers.end()),
+                    referrers.end());
+  } else {
+    for (factories_t::const_reference entry : m_factories) {
+      for (Any* any : entry.second->getObjects()) {
+        if (!isGarbage(any)) referrers.emplace_back(any);
+      }
+    }
+  }
+  std::vector<const Any*> references;
+  for (Any* any : referrers) {
+    references.clear();
+    any->collectReferences(references);
+    replacements_t replacements;
+    for (const Any* reference : references) {
+      if (isGarbage(reference)) replacements.emplace(reference, nullptr);
+    }
+    if (!replacements.empty()) any->swap(replacements);
+  }
+  unindexReferrers(garbage);
+
+  // The referrers, flagged dirty by their swaps, are settled.
+  for (Any* any : m_dirtyObjects) {
+    if (!isGarbage(any)) any->m_dirty = false;
+  }
+  m_dirtyObjects.clear();
+}
+
+void Serializer::collectGarbage(uint32_t threadCount) {
+  if (!m_enableGC || m_partial) return;
+  materializeAll();
+  if (threadCount == 0) {
+    threadCount = std::max(1U, std::thread::hardware_concurrency());
+  }
 
   Factory* const designFactory = m_factories[UhdmType::Design];
   if (TypespecUnifier* const unifier = new TypespecUnifier) {
@@ -386,24 +698,120 @@ void Serializer::collectGarbage() {
     delete unifier;
   }
 
-  if (ReferenceCollector* const collector = new ReferenceCollector) {
-    AnySet erased;
-    while (true) {
-      replacements_t replacements = collector->getReplacements(designFactory);
-      if (!replacements.empty()) swap(replacements);
+  // Objects have a single parent, so the subtrees of the live objects are
+  // disjoint and marked in parallel.
+  Marks live(m_factories);
+  std::vector<const Any*> references;
+  std::vector<const Any*> pending;
+  for (const Any* design : designFactory->getObjects()) {
+    if (live.mark(design)) pending.emplace_back(design);
+  }
+  // Breadth first until there are enough subtrees to share.
+  const size_t subtreeCount = (threadCount == 1) ? 0 : 16 * threadCount;
+  size_t next = 0;
+  while ((next < pending.size()) && (pending.size() - next < subtreeCount)) {
+    live.markChildren(pending[next++], references, pending);
+  }
+  if (next < pending.size()) {
+    ThreadPool::parallelFor(
+        threadCount, pending.size() - next, [&](size_t i) {
+          std::vector<const Any*> subtreeReferences;
+          std::vector<const Any*> subtree(1, pending[next + i]);
+          while (!subtree.empty()) {
+            const Any* const parent = subtree.back();
+            subtree.pop_back();
+            live.markChildren(parent, subtreeReferences, subtree);
+          }
+        });
+  }
+
+  std::vector<const Any*> garbage;
+  for (factories_t::const_reference entry : m_factories) {
+    for (const Any* any : entry.second->getObjects()) {
+      if (!live.isMarked(any)) garbage.emplace_back(any);
+    }
+  }
+  const auto isGarbage = [&live](const Any* any) {
+    return !live.isMarked(any);
+  };
+  sweepGarbage(garbage, isGarbage);
+
+  for (factories_t::const_reference entry : m_factories) {
+    if (!garbage.empty()) entry.second->eraseIf(isGarbage);
+    for (Any* any : entry.second->getObjects()) any->m_dirty = false;
+  }
+  m_dirtyObjects.clear();
+  m_collected = m_indexedReferrers;
+}
+
+void Serializer::collectChangedGarbage() {
+  if (!m_enableGC || m_partial) return;
+  if (!m_collected) {
+    // The next collections find the referrers of the garbage in the index.
+    if (!m_indexedReferrers) indexReferrers();
+    collectGarbage();
+    return;
+  }
 
-      for (factories_t::const_reference entry : m_factories) {
-        entry.second->eraseIfNotIn(collector->m_referenced, erased);
+  updateReferrers();
+  const std::vector<Any*> changed = std::move(m_dirtyObjects);
+  m_dirtyObjects.clear();
+
+  // The objects left by the last collection were all live. A clean one still
+  // is if its parent is, a dirty one if its parent also still refers to it.
+  // Designs are live. Settled once for all the objects on the way up, which
+  // are dead until then, so that cycles are.
+  std::unordered_map<const Any*, bool> live;
+  std::vector<const Any*> path;
+  std::vector<const Any*> garbage;
+  for (const Any* any : changed) {
+    path.clear();
+    bool isLive = false;
+    for (const Any* up = any;;) {
+      if (auto it = live.find(up); it != live.end()) {
+        isLive = it->second;
+        break;
+      }
+      path.emplace_back(up);
+      live.emplace(up, false);
+      if (up->getUhdmType() == UhdmType::Design) {
+        isLive = true;
+        break;
       }
+      const Any* const parent = up->getParent();
+      if ((parent == nullptr) || (up->m_dirty && !refersTo(parent, up))) {
+        break;
+      }
+      up = parent;
+    }
+    if (isLive) {
+      for (const Any* on : path) live[on] = true;
+    } else {
+      garbage.emplace_back(any);
+    }
+  }
 
-      if (replacements.empty()) break;
-      collector->m_visited.clear();
-      collector->m_callstack.clear();
-      collector->m_referenced.clear();
+  // The children of the garbage are too.
+  std::unordered_set<const Any*> dead(garbage.cbegin(), garbage.cend());
+  for (size_t i = 0; i < garbage.size(); ++i) {
+    auto it = m_references.find(garbage[i]);
+    if (it == m_references.end()) continue;
+    for (const Any* child : it->second) {
+      if ((child->getParent() == garbage[i]) &&
+          (child->getUhdmType() != UhdmType::Design) &&
+          dead.emplace(child).second) {
+        garbage.emplace_back(child);
+      }
     }
+  }
 
-    delete collector;
+  for (Any* any : changed) {
+    if (dead.find(any) == dead.cend()) any->m_dirty = false;
   }
+  sweepGarbage(garbage, [&dead](const Any* any) {
+    return dead.find(any) != dead.cend();
+  });
+  for (const Any* any : garbage) m_factories[any->getUhdmType()]->erase(any);
 }
 
 void DefaultErrorHandler(ErrorType errType, const std::string& errorMsg,
@@ -433,6 +841,7 @@ SymbolCollection* Serializer::makeSymbolCollection() {
 }
 
 Serializer::IdMap Serializer::getAllObjects() const {
+  const_cast<Serializer*>(this)->materializeAll();
   IdMap idMap;
   for (factories_t::const_reference entry : m_factories) {
     entry.second->mapToIndex(idMap);
@@ -456,23 +865,29 @@ std::string VpiTypeName(vpiHandle h) {
 
 std::map<std::string, uint32_t, std::less<>> Serializer::getObjectStats()
     const {
+  // Objects of a lazy restore that are not created yet are counted from the
+  // file, rather than materialized.
   std::map<std::string, uint32_t, std::less<>> stats;
   for (factories_t::const_reference entry : m_factories) {
-    stats.emplace(UhdmName(entry.first), entry.second->m_objects.size());
+    stats.emplace(UhdmName(entry.first), entry.second->getObjects().size() +
+                                             getPendingObjectCount(entry.first));
   }
   return stats;
 }
 
 void Serializer::printStats(std::ostream& strm,
                             std::string_view infoText) const {
+  printStats(strm, infoText, getObjectStats());
+}
+
+void Serializer::printStats(
+    std::ostream& strm, std::string_view infoText,
+    const std::map<std::string, uint32_t, std::less<>>& stats) {
   strm << "=== UHDM Object Stats Begin (" << infoText << ") ===" << std::endl;
-  auto stats = getObjectStats();
   std::vector<std::string_view> names;
   names.reserve(stats.size());
   std::transform(stats.begin(), stats.end(), std::back_inserter(names),
-                 [](decltype(stats)::value_type const& pair) {
-                   return std::string_view(pair.first);
-                 });
+                 [](const auto& pair) { return std::string_view(pair.first); });
   std::sort(names.begin(), names.end());
 
   size_t total = 0;
@@ -492,20 +907,115 @@ void Serializer::printStats(std::ostream& strm,
   strm << "=== UHDM Object Stats End ===" << std::endl;
 }
 
+Serializer::MemoryStats Serializer::getMemoryStats() const {
+  MemoryStats stats;
+  std::vector<SymbolId> symbols;
+  for (factories_t::const_reference entry : m_factories) {
+    const Factory* const factory = entry.second;
+    MemoryStats::Usage usage;
+
+    symbols.clear();
+    for (const Any* any : factory->getObjects()) any->collectSymbols(symbols);
+    usage.objects = factory->m_storage.getAllocatedSize() +
+                    factory->m_objects.capacity() * sizeof(Any*);
+
+    usage.collections = factory->m_collections.capacity() * sizeof(void*);
+    for (const Factory::objects_t* collection : factory->getCollections()) {
+      usage.collections +=
+          sizeof(Factory::objects_t) + collection->capacity() * sizeof(Any*);
+    }
+
+    std::sort(symbols.begin(), symbols.end(), SymbolIdLessThanComparer());
+    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+    for (SymbolId id : symbols) usage.symbols += getSymbol(id).size();
+
+    if ((usage.objects > 0) || (usage.collections > 0)) {
+      stats.types.emplace(entry.first, usage);
+    }
+  }
+  stats.symbolTable = m_symbolFactory.getMemoryUsage();
+  return stats;
+}
+
+void Serializer::printMemoryStats(std::ostream& strm,
+                                  std::string_view infoText) const {
+  const MemoryStats stats = getMemoryStats();
+  strm << "=== UHDM Memory Stats Begin (" << infoText << ") ===" << std::endl;
+  strm << std::setw(48) << std::left << "Bytes by type:" << std::setw(12)
+       << std::right << "objects" << std::setw(12) << "collections"
+       << std::setw(12) << "symbols" << std::endl;
+
+  MemoryStats::Usage total;
+  for (const auto& [type, usage] : stats.types) {
+    strm << std::setw(48) << std::left << UhdmName(type) << std::setw(12)
+         << std::right << usage.objects << std::setw(12) << usage.collections
+         << std::setw(12) << usage.symbols << std::endl;
+    total.objects += usage.objects;
+    total.collections += usage.collections;
+    total.symbols += usage.symbols;
+  }
+  strm << std::string(84, '-') << std::endl;
+  strm << std::setw(48) << std::left << "Total:" << std::setw(12)
+       << std::right << total.objects << std::setw(12) << total.collections
+       << std::setw(12) << total.symbols << std::endl;
+  strm << std::setw(48) << std::left << "Symbol table:" << std::setw(12)
+       << std::right << stats.symbolTable << std::endl;
+  strm << "=== UHDM Memory Stats End ===" << std::endl;
+}
+
 bool Serializer::erase(const BaseClass* p) {
   if (p == nullptr) {
     return true;
   }
 
+  materializeAll();
+  unindexReferrers({p});
+  m_collected = false;
+  m_dirtyObjects.clear();
   return m_factories[p->getUhdmType()]->erase(p);
 }
 
+uint32_t Serializer::eraseAll(const std::vector<const Any*>& objects) {
+  materializeAll();
+  std::vector<const Any*> erased;
+  erased.reserve(objects.size());
+  for (const Any* p : objects) {
+    if (p != nullptr) erased.emplace_back(p);
+  }
+  unindexReferrers(erased);
+  m_collected = false;
+  m_dirtyObjects.clear();
+  uint32_t count = 0;
+  for (const Any* p : objects) {
+    if ((p != nullptr) && m_factories[p->getUhdmType()]->erase(p)) ++count;
+  }
+  return count;
+}
+
+void Serializer::resetBaseline() {
+  for (factories_t::const_reference entry : m_factories) {
+    entry.second->resetBaseline();
+  }
+  m_baselineSymbolCount = m_symbolFactory.getSymbolCount();
+  m_baselineSymbolIds.clear();
+  m_hasBaseline = true;
+}
+
 void Serializer::purge() {
+  m_lazyRestore.reset();
+  m_hasBaseline = false;
+  m_partial = false;
+  m_collected = false;
+  m_baselineSymbolCount = 0;
+  m_baselineSymbolIds.clear();
   m_symbolFactory.purge();
   m_uhdmHandleFactory.purge();
   for (factories_t::const_reference entry : m_factories) {
     entry.second->purge();
   }
+  m_collectionStorage.clear();
+  m_clientData.clear();
+  clearReferrers();
 }
 
 #ifndef SWIG
@@ -32,12 +32,17 @@
 #include <uhdm/containers.h>
 #include <uhdm/vpi_uhdm.h>
 
+#include <algorithm>
+#include <cstddef>
 #include <filesystem>
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #define UHDM_MAX_BIT_WIDTH (1024 * 1024)
@@ -70,7 +75,8 @@ enum ErrorType {
   UHDM_NON_TEMPORAL_SEQUENCE_USE = 730,
   UHDM_NON_POSITIVE_VALUE = 731,
   UHDM_SIGNED_UNSIGNED_PORT_CONN = 732,
-  UHDM_FORCING_UNSIGNED_TYPE = 733
+  UHDM_FORCING_UNSIGNED_TYPE = 733,
+  UHDM_UNSUPPORTED_FILE_VERSION = 734
 };
 
 #ifndef SWIG
@@ -82,6 +88,80 @@ void DefaultErrorHandler(ErrorType errType, const std::string& errorMsg,
                          const Any* object1, const Any* object2);
 #endif
 
+// Storage for objects of a single size, handed out from slabs of contiguous
+// storage that are only freed all at once. Slabs double in size from
+// kMinSlabCapacity objects up to kMaxSlabCapacity, unless reserve() asks for
+// more. Released storage is reused before any new slab is added.
+class SlabAllocator final {
+ public:
+  void* allocate(size_t size) {
+    if (!m_freeList.empty()) {
+      void* const storage = m_freeList.back();
+      m_freeList.pop_back();
+      return storage;
+    }
+    if (m_slabUsed == m_slabCapacity) {
+      addSlab(size, std::clamp(m_slabCapacity * 2, kMinSlabCapacity,
+                               kMaxSlabCapacity));
+    }
+    return m_slabs.back().get() + m_stride * m_slabUsed++;
+  }
+
+  // Makes room for count more objects, in a single slab.
+  void reserve(size_t size, size_t count) {
+    if (m_slabCapacity - m_slabUsed < count) {
+      addSlab(size, std::max(count, kMinSlabCapacity));
+    }
+  }
+
+  // The object stored there must be destroyed already.
+  void release(void* storage) { m_freeList.emplace_back(storage); }
+
+  // Bytes of all the slabs, handed out or not.
+  size_t getAllocatedSize() const { return m_allocatedSize; }
+
+  // Takes over the slabs of the other allocator, which is left empty.
+  void adopt(SlabAllocator& other) {
+    m_slabs.insert(m_slabs.begin(),
+                   std::make_move_iterator(other.m_slabs.begin()),
+                   std::make_move_iterator(other.m_slabs.end()));
+    m_freeList.insert(m_freeList.end(), other.m_freeList.cbegin(),
+                      other.m_freeList.cend());
+    m_allocatedSize += other.m_allocatedSize;
+    other.clear();
+  }
+
+  // Frees every slab, the objects stored there must be destroyed already.
+  void clear() {
+    m_slabs.clear();
+    m_allocatedSize = 0;
+    m_slabCapacity = 0;
+    m_slabUsed = 0;
+    m_freeList.clear();
+  }
+
+ private:
+  static constexpr size_t kMinSlabCapacity = 8;
+  static constexpr size_t kMaxSlabCapacity = 4096;
+
+  void addSlab(size_t size, size_t capacity) {
+    // Objects are kept aligned to std::max_align_t.
+    m_stride = (size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+    m_slabs.emplace_back(new std::max_align_t[m_stride * capacity]);
+    m_allocatedSize += sizeof(std::max_align_t) * m_stride * capacity;
+    m_slabCapacity = capacity;
+    m_slabUsed = 0;
+  }
+
+  std::vector<std::unique_ptr<std::max_align_t[]>> m_slabs;
+  size_t m_stride = 0;  // In std::max_align_t.
+  size_t m_slabCapacity = 0;  // Objects in the last slab.
+  size_t m_slabUsed = 0;
+  size_t m_allocatedSize = 0;
+  std::vector<void*> m_freeList;
+};
+
+// Objects of one type, constructed in slabs of contiguous storage.
 class Factory final {
   friend Serializer;
 
@@ -91,71 +171,175 @@ class Factory final {
  public:
   template <typename T>
   T* make() {
-    T* const any = new T;
+    T* const any = new (m_storage.allocate(sizeof(T))) T;
+    any->m_slot = static_cast<uint32_t>(m_objects.size());
     m_objects.emplace_back(any);
     return any;
   }
 
+  // Makes room for count more objects, in a single slab.
+  template <typename T>
+  void reserve(size_t count) {
+    m_objects.reserve(m_objects.size() + count);
+    m_storage.reserve(sizeof(T), count);
+  }
+
+  // Collections are constructed in the given storage, shared by the
+  // factories of a serializer. Collections of any type have the same layout.
   template <typename T>
-  std::vector<T*>* makeCollection() {
-    std::vector<T*>* const collection = new std::vector<T*>;
+  std::vector<T*>* makeCollection(SlabAllocator* storage) {
+    std::vector<T*>* const collection =
+        new (storage->allocate(sizeof(std::vector<T*>))) std::vector<T*>;
     m_collections.emplace_back((objects_t*)collection);
     return collection;
   }
 
+  // Constant time, the object only leaves an empty slot behind. Empty slots
+  // are dropped on the next access to the objects, see compact().
   bool erase(const Any* any) {
-    for (objects_t::const_iterator itr = m_objects.begin();
-         itr != m_objects.end(); ++itr) {
-      if ((*itr) == any) {
-        delete any;
-        m_objects.erase(itr);
-        return true;
-      }
-    }
-    return false;
+    const uint32_t slot = any->m_slot;
+    if ((slot >= m_objects.size()) || (m_objects[slot] != any)) return false;
+    m_objects[slot] = nullptr;
+    ++m_emptySlotCount;
+    destroy(any);
+    return true;
   }
 
-  void eraseIfNotIn(const AnySet& container, AnySet& erased) {
-    objects_t keepers;
+  // Slots stay put while the predicate is asked, the survivors are
+  // compacted at the end.
+  template <typename Predicate>
+  void eraseIf(Predicate predicate) {
     for (objects_t::reference any : m_objects) {
-      if (container.find(any) == container.cend()) {
-        erased.emplace(any);
-        delete any;
-      } else {
-        keepers.emplace_back(any);
+      if ((any != nullptr) && predicate(any)) {
+        destroy(any);
+        any = nullptr;
+        ++m_emptySlotCount;
       }
     }
-    keepers.swap(m_objects);
+    compact();
   }
 
   void mapToIndex(std::map<const Any*, uint32_t>& table,
                   uint32_t index = 1) const {
-    for (objects_t::const_reference any : m_objects) {
+    for (objects_t::const_reference any : getObjects()) {
       table.emplace(any, index++);
     }
   }
 
   void purge() {
     for (objects_t::reference any : m_objects) {
-      delete any;
+      if (any != nullptr) any->~Any();
     }
+    // The storage of the collections is freed by their serializer.
     for (collections_t::reference collection : m_collections) {
-      delete collection;
+      collection->~objects_t();
     }
 
+    m_storage.clear();
     m_objects.clear();
+    m_emptySlotCount = 0;
     m_collections.clear();
+    m_baselineCount = 0;
+    m_erasedFromBaseline.clear();
   }
 
-  const objects_t& getObjects() { return m_objects; }
-  const objects_t& getObjects() const { return m_objects; }
+  const objects_t& getObjects() {
+    compact();
+    return m_objects;
+  }
+  const objects_t& getObjects() const {
+    const_cast<Factory*>(this)->compact();
+    return m_objects;
+  }
 
   const collections_t& getCollections() { return m_collections; }
   const collections_t& getCollections() const { return m_collections; }
 
  private:
+  void destroy(const Any* any) {
+    Any* const object = const_cast<Any*>(any);
+    object->setClientData(nullptr);
+    // Stale references to the released memory don't resolve to this
+    // serializer anymore when saved.
+    object->m_serializer = nullptr;
+    object->~Any();
+    m_storage.release(object);
+  }
+
+  void updateSlots(size_t from) {
+    for (size_t i = from, n = m_objects.size(); i < n; ++i) {
+      m_objects[i]->m_slot = static_cast<uint32_t>(i);
+    }
+  }
+
+  // Drops the empty slots left by erased objects, the objects after them
+  // move down in order. Erased objects of the baseline are recorded then.
+  void compact() {
+    if (m_emptySlotCount == 0) return;
+    const uint32_t survivors = getBaselineSurvivorCount();
+    std::vector<uint32_t> erasedFromBaseline;
+    uint32_t position = 0;
+    std::vector<uint32_t>::const_iterator skipped = m_erasedFromBaseline.cbegin();
+    uint32_t kept = 0;
+    for (uint32_t slot = 0, n = static_cast<uint32_t>(m_objects.size());
+         slot < n; ++slot) {
+      Any* const any = m_objects[slot];
+      const bool fromBaseline = slot < survivors;
+      if (fromBaseline) {
+        while ((skipped != m_erasedFromBaseline.cend()) &&
+               (*skipped == position)) {
+          ++skipped;
+          ++position;
+        }
+      }
+      if (any == nullptr) {
+        if (fromBaseline) erasedFromBaseline.emplace_back(position);
+      } else {
+        any->m_slot = kept;
+        m_objects[kept++] = any;
+      }
+      if (fromBaseline) ++position;
+    }
+    m_objects.resize(kept);
+    m_emptySlotCount = 0;
+    mergeErasedFromBaseline(erasedFromBaseline);
+  }
+
+  // The baseline is the content of the factory at the last full save or
+  // restore, see Serializer::SaveOptions::delta. Objects are never reordered,
+  // so the first getBaselineSurvivorCount() objects are the ones of the
+  // baseline still alive, in the same order, and the objects made since
+  // follow. Only valid once compacted.
+  uint32_t getBaselineSurvivorCount() const {
+    return m_baselineCount - static_cast<uint32_t>(m_erasedFromBaseline.size());
+  }
+
+  void mergeErasedFromBaseline(const std::vector<uint32_t>& positions) {
+    if (positions.empty()) return;
+    const size_t count = m_erasedFromBaseline.size();
+    m_erasedFromBaseline.insert(m_erasedFromBaseline.end(), positions.cbegin(),
+                                positions.cend());
+    std::inplace_merge(m_erasedFromBaseline.begin(),
+                       m_erasedFromBaseline.begin() + count,
+                       m_erasedFromBaseline.end());
+  }
+
+  // Makes the current objects the baseline.
+  void resetBaseline() {
+    compact();
+    for (objects_t::reference any : m_objects) any->m_modified = false;
+    m_baselineCount = static_cast<uint32_t>(m_objects.size());
+    m_erasedFromBaseline.clear();
+  }
+
   objects_t m_objects;
   collections_t m_collections;
+
+  SlabAllocator m_storage;
+  uint32_t m_emptySlotCount = 0;
+
+  uint32_t m_baselineCount = 0;
+  std::vector<uint32_t> m_erasedFromBaseline;  // Sorted positions.
 };
 
 class Serializer final {
@@ -163,6 +347,73 @@ class Serializer final {
   using IdMap = std::map<const BaseClass*, uint32_t>;
   static constexpr uint32_t kBadIndex = static_cast<uint32_t>(-1);
   static const uint32_t kVersion;
+  // Files of this version are a single message, saved before the sections
+  // (see FileHeader). They are still restored.
+  static const uint32_t kLegacyVersion;
+
+#ifndef SWIG
+  // On-disk encoding of the serialized database.
+  enum class Encoding : uint32_t {
+    Packed = 0,  // Cap'n Proto packed stream, smallest on disk.
+    Flat = 1,    // Unpacked words, restored in place from a memory mapping.
+    // Unpacked words in independently compressed blocks (see BlockCodec),
+    // decompressed in parallel on restore.
+    Compressed = 2,
+  };
+
+  struct SaveOptions final {
+    Encoding encoding = Encoding::Packed;
+
+    // Number of threads encoding the per-type sections, 0 for one per
+    // hardware thread. Sections are written as soon as they are encoded.
+    uint32_t threads = 1;
+
+    // Write a patch holding only what changed since the last full save or
+    // restore (the snapshot): objects created, erased or modified, and new
+    // symbols. Patches are cumulative, each one applies to the snapshot
+    // directly, see RestoreOptions::patch. Garbage isn't collected. Without a
+    // snapshot (nothing saved or restored yet, or a selective restore) a full
+    // save is written instead.
+    bool delta = false;
+
+    // On a full save, write only the symbols the objects refer to, renumbered
+    // densely and sorted by text. Only the file is renumbered: the symbols
+    // and their ids in memory stay as they are. Deltas saved against this
+    // snapshot map their symbols through its numbering.
+    bool compactSymbols = true;
+  };
+
+  // Restore reads the encoding from the file.
+  struct RestoreOptions final {
+    // Create objects only when first reached from a restored design and
+    // restore their relations only when first accessed. The file stays mapped
+    // until everything is materialized or the serializer is purged.
+    bool lazy = false;
+
+    // Number of threads filling the restored objects, 0 for one per hardware
+    // thread. Ignored by lazy restores.
+    uint32_t threads = 1;
+
+    // Selective restore: only the objects of these types (abstract ones like
+    // UhdmType::Typespec included), the instance at this dotted hierarchical
+    // path (e.g. "top.u1.u2") and everything they refer to, directly or not,
+    // are restored. Parents of restored objects are created with their
+    // properties only, so that their relations stay empty. Restore then
+    // returns handles to the selected objects instead of the designs.
+    // Selective restores are never lazy. Garbage isn't collected after them,
+    // since the restored objects can't be reached from the designs: saves
+    // write what was restored as is.
+    std::set<UhdmType> types;
+    std::string instancePath;
+
+    // Patch saved with SaveOptions::delta, applied on top of the restored
+    // file, which must be the snapshot it was saved against. The snapshot
+    // stays the restored file, so that later deltas remain patches of it.
+    // Such restores are neither lazy nor selective. A full save passed as
+    // the patch is restored on its own.
+    std::string patch;
+  };
+#endif
 
   Serializer();
   ~Serializer();
@@ -170,10 +421,24 @@ class Serializer final {
 #ifndef SWIG
   void save(const std::filesystem::path& filepath);
   void save(const std::string& filepath);
+  void save(const std::filesystem::path& filepath, const SaveOptions& options);
+  void save(const std::string& filepath, const SaveOptions& options);
   void purge();
 
   void setGCEnabled(bool enabled) { m_enableGC = enabled; }
-  void collectGarbage();
+  // Erases the objects that aren't owned, through their parents, by a design
+  // and drops the references to them. Marking runs on threadCount threads, 0
+  // for one per hardware thread. Does nothing after a selective restore, see
+  // RestoreOptions::types.
+  void collectGarbage(uint32_t threadCount = 1);
+  // Same, after a first collectGarbage(), for what changed since the last
+  // collection: only the objects made or flagged since (see
+  // BaseClass::touch()), and the children their parents dropped,
+  // are revisited, and typespecs aren't unified. The garbage is found below
+  // them, and its referrers in the index, see indexReferrers(); the index is
+  // built first if missing. Collects everything again if objects were
+  // erased or restored since, or the index was cleared.
+  void collectChangedGarbage();
 
   void setErrorHandler(ErrorHandler handler) { m_errorHandler = handler; }
   ErrorHandler getErrorHandler() { return m_errorHandler; }
@@ -182,18 +447,75 @@ class Serializer final {
 
   template <typename T>
   Factory* getFactory() {
+    materializeAll();
     return m_factories[T::kUhdmType];
   }
+
+  // Completes a lazy restore, creating every remaining object of the file.
+  void materializeAll();
 #endif
 
   const std::vector<vpiHandle> restore(const std::filesystem::path& filepath);
   const std::vector<vpiHandle> restore(const std::string& filepath);
+#ifndef SWIG
+  const std::vector<vpiHandle> restore(const std::filesystem::path& filepath,
+                                       const RestoreOptions& options);
+  const std::vector<vpiHandle> restore(const std::string& filepath,
+                                       const RestoreOptions& options);
+#endif
   std::map<std::string, uint32_t, std::less<>> getObjectStats() const;
   void printStats(std::ostream& strm, std::string_view infoText) const;
 
+#ifndef SWIG
+  // Read from the table of contents of a saved file, without decoding any
+  // object.
+  struct FileInfo final {
+    uint32_t version = 0;
+    Encoding encoding = Encoding::Packed;
+    bool patch = false;  // Saved with SaveOptions::delta.
+    uint32_t symbolCount = 0;  // Only the new symbols in a patch.
+
+    // Objects by type name, like getObjectStats(), only the created and
+    // modified ones in a patch. Left empty when the file was saved with
+    // a version that can't be restored.
+    std::map<std::string, uint32_t, std::less<>> objectStats;
+  };
+
+  // Returns false if the file can't be read or isn't a saved file.
+  static bool readFileInfo(const std::filesystem::path& filepath,
+                           FileInfo* info);
+
+  static void printStats(
+      std::ostream& strm, std::string_view infoText,
+      const std::map<std::string, uint32_t, std::less<>>& stats);
+
+  // Bytes held in memory, estimated from the capacity of the containers.
+  // Objects of a lazy restore that aren't created yet aren't counted.
+  struct MemoryStats final {
+    struct Usage final {
+      uint64_t objects = 0;  // Their slabs, and their factory's list of them.
+      uint64_t collections = 0;  // Collections of objects of the type.
+      uint64_t symbols = 0;  // Text of the distinct symbols they refer to.
+    };
+    std::map<UhdmType, Usage> types;  // Only the types with any usage.
+    uint64_t symbolTable = 0;  // All the symbols, lookup included.
+  };
+  MemoryStats getMemoryStats() const;
+  void printMemoryStats(std::ostream& strm, std::string_view infoText) const;
+#endif
+
   void swap(const Any* what, Any* with);
   void swap(const std::map<const Any*, Any*>& replacements);
 
+  // Swaps visit every object unless the objects referring to each one are
+  // indexed, then only those are visited. The index is built by
+  // indexReferrers() and kept up to date: objects made or flagged as
+  // changed since, see BaseClass::touch(), are indexed again before it is
+  // used.
+  void indexReferrers();
+  void clearReferrers();
+  bool hasReferrerIndex() const { return m_indexedReferrers; }
+
 #ifndef SWIG
  private:
   template <typename T>
@@ -201,17 +523,20 @@ class Serializer final {
     T *const obj = factory->template make<T>();
     obj->setSerializer(this);
     obj->setUhdmId(++m_objId);
+    if (m_collected) m_dirtyObjects.emplace_back(obj);
+    if (m_indexedReferrers) m_unindexedObjects.emplace_back(obj);
     return obj;
   }
 
   template <typename T>
   void make(Factory *const factory, uint32_t count) {
+    factory->template reserve<T>(count);
     for (uint32_t i = 0; i < count; ++i) make<T>(factory);
   }
 
   template <typename T>
   std::vector<T *> *makeCollection(Factory *const factory) {
-    return factory->template makeCollection<T>();
+    return factory->template makeCollection<T>(&m_collectionStorage);
   }
 
  public:
@@ -239,6 +564,8 @@ class Serializer final {
   vpiHandle makeUhdmHandle(UhdmType type, const void* object);
 
   bool erase(const BaseClass* p);
+  // Returns how many of the objects were erased.
+  uint32_t eraseAll(const std::vector<const Any*>& objects);
 
 #ifndef SWIG
   void pushScope(Any* s);
@@ -266,13 +593,120 @@ class Serializer final {
   struct RestoreAdapter;
   friend struct RestoreAdapter;
 
+  friend class BaseClass;
+
  private:
   template<typename T>
   T* getObject(uint32_t type, uint32_t index) const;
 
+  void materialize(BaseClass* object);
+
+  // A saved file is a FileHeader, a table of contents of sectionCount
+  // SectionEntry, then the sections. A section is a UhdmRoot message holding
+  // only the objects of one type, or only the symbols.
+  static constexpr uint32_t kMagic = 0x4d444855;  // "UHDM"
+  static constexpr uint32_t kSymbolsSection = static_cast<uint32_t>(-1);
+
+  struct FileHeader final {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t encoding;
+    uint32_t sectionCount;
+  };
+
+  struct SectionEntry final {
+    uint32_t type;  // UhdmType of the objects, or kSymbolsSection.
+    uint32_t count;
+    uint64_t offset;  // From the start of the file.
+    uint64_t size;
+  };
+
+  // Sections of Encoding::Compressed start with a BlockHeader, then the
+  // compressed size of each block as a uint32_t, then the blocks. Blocks
+  // decompress to blockSize bytes, the last one to what is left of size.
+  static constexpr uint32_t kCompressedBlockSize = 1 << 20;
+
+  struct BlockHeader final {
+    uint64_t size;  // Of the flat message.
+    uint32_t blockSize;
+    uint32_t blockCount;
+  };
+
+  // A patch (see SaveOptions::delta) starts with kPatchMagic. Its sections
+  // hold only the created and modified objects, and the symbols made since
+  // the snapshot. The kPatchSection is raw: a PatchHeader then, for each
+  // changed type, a PatchEntry followed by the sorted positions of the erased
+  // objects in the snapshot and the sorted slots of the written objects in
+  // the patched design.
+  static constexpr uint32_t kPatchMagic = 0x50444855;  // "UHDP"
+  static constexpr uint32_t kPatchSection = static_cast<uint32_t>(-2);
+
+  struct PatchHeader final {
+    uint32_t snapshotSymbolCount;
+    uint32_t entryCount;
+  };
+
+  struct PatchEntry final {
+    uint32_t type;
+    uint32_t snapshotCount;
+    uint32_t count;
+    uint32_t erasedCount;
+    uint32_t writtenCount;
+  };
+
+  uint32_t getPendingObjectCount(UhdmType type) const;
+
+  // Makes the current design the snapshot deltas are saved against.
+  void resetBaseline();
+
+  // Drops the references of the other objects to the garbage, and the
+  // garbage from the index, before it is erased.
+  struct Marks;
+  template <typename IsGarbage>
+  void sweepGarbage(const std::vector<const Any*>& garbage,
+                    IsGarbage isGarbage);
+  // Queues any, changed, see BaseClass::touch().
+  void onTouched(Any* any);
+  // Queues any for the next collectChangedGarbage().
+  void flagDirty(Any* any);
+
+  // Of the objects any refers to, sorted and each one once.
+  static std::vector<const Any*> getReferences(const Any* any);
+  // Queues any, changed, to be indexed again.
+  void unindex(Any* any);
+  // Indexes again the queued objects, from what they referred to before.
+  // The children they dropped are flagged dirty.
+  void updateReferrers();
+  // Whether any is indexed as referring to reference.
+  bool refersTo(const Any* any, const Any* reference) const;
+  // Swaps in the indexed referrers of the replaced objects.
+  template <typename SwapOne>
+  void swapReferrers(const std::vector<const Any*>& replaced, SwapOne swapOne);
+  // Drops the objects, about to be erased, from the index.
+  void unindexReferrers(const std::vector<const Any*>& erased);
+
+  struct SavedFile;
+  struct Patch;
+  struct LazyRestore;
+  struct LazyRestoreDeleter final {
+    void operator()(LazyRestore* lazyRestore) const;
+  };
+
   uint64_t m_version = 0;
   uint32_t m_objId = 0;
   bool m_enableGC = true;
+  // Whether all objects were live at the last collection, none was erased
+  // since and the referrers are indexed, see collectChangedGarbage().
+  bool m_collected = false;
+  // Made or changed since the last collection, see flagDirty().
+  std::vector<Any*> m_dirtyObjects;
+  bool m_hasBaseline = false;
+  // Whether only part of a file was restored, see RestoreOptions::types.
+  bool m_partial = false;
+  uint32_t m_baselineSymbolCount = 0;
+  // Ids in the snapshot of the symbols by their raw id, empty when they are
+  // the same, see SaveOptions::compactSymbols.
+  std::vector<RawSymbolId> m_baselineSymbolIds;
   ErrorHandler m_errorHandler = DefaultErrorHandler;
 
   SymbolFactory m_symbolFactory;
@@ -283,6 +717,21 @@ class Serializer final {
 
   using factories_t = std::map<UhdmType, Factory*>;
   factories_t m_factories;
+  SlabAllocator m_collectionStorage;  // Of the collections of all factories.
+
+  std::unique_ptr<LazyRestore, LazyRestoreDeleter> m_lazyRestore;
+
+  // See BaseClass::getClientData().
+  std::unordered_map<const BaseClass*, ClientData*> m_clientData;
+
+  // See indexReferrers(). The objects each object refers to, as returned by
+  // getReferences(), and the other way around, each referrer once in each
+  // list.
+  std::unordered_map<const Any*, std::vector<const Any*>> m_references;
+  std::unordered_map<const Any*, std::vector<Any*>> m_referrers;
+  // Made or changed since indexed, see unindex().
+  std::vector<Any*> m_unindexedObjects;
+  bool m_indexedReferrers = false;
 #endif
 };
 
@@ -35,37 +35,461 @@
   #include <unistd.h>
 #endif
 
+#if defined(_MSC_VER) || defined(__MINGW32__)
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <capnp/message.h>
 #include <capnp/serialize-packed.h>
+#include <capnp/serialize.h>
+#include <kj/debug.h>
 
 #include "UHDM.capnp.h"
+#include <uhdm/BlockCodec.h>
+#include <uhdm/ThreadPool.h>
 #include <uhdm/uhdm.h>
 
 #include "uhdm/config.h"
 
 namespace uhdm {
-static constexpr std::string_view kUnknownRawSymbol = "<unknown>";
+// Read-only memory mapping of an entire file. Pages are brought in by the OS
+// on first access, so a flat encoded message can be read without any copy.
+class MappedFile final {
+ public:
+  explicit MappedFile(const std::string& filepath) {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    m_file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) return;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || (size.QuadPart == 0)) return;
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr) return;
+    m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data != nullptr) m_size = static_cast<size_t>(size.QuadPart);
+#else
+    const int32_t fileid = open(filepath.c_str(), O_RDONLY | O_BINARY);
+    if (fileid < 0) return;
+    struct stat info;
+    if ((fstat(fileid, &info) == 0) && (info.st_size > 0)) {
+      void* const data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fileid, 0);
+      if (data != MAP_FAILED) {
+        m_data = data;
+        m_size = info.st_size;
+      }
+    }
+    // The mapping keeps its own reference to the file.
+    close(fileid);
+#endif
+  }
 
-template<typename T>
-T* Serializer::getObject(uint32_t type, uint32_t index) const {
-  if (index == kBadIndex) {
-    return nullptr;
+  ~MappedFile() {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    if (m_data != nullptr) UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr) CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+    if (m_data != nullptr) munmap(m_data, m_size);
+#endif
   }
 
-  factories_t::const_iterator it = m_factories.find(static_cast<UhdmType>(type));
-  return it != m_factories.cend() ? any_cast<T>(it->second->m_objects[index]) : nullptr;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool isValid() const { return m_data != nullptr; }
+
+  kj::ArrayPtr<const kj::byte> getBytes() const {
+    return kj::ArrayPtr<const kj::byte>(static_cast<const kj::byte*>(m_data), m_size);
+  }
+
+ private:
+  void* m_data = nullptr;
+  size_t m_size = 0;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+  HANDLE m_file = INVALID_HANDLE_VALUE;
+  HANDLE m_mapping = nullptr;
+#endif
+};
+
+// Sections of a saved file (see Serializer::FileHeader), read in place from
+// the file mapping. Only the header and the table of contents are read up
+// front. Section messages are decoded on first access, or all at once with
+// load(). Files of kLegacyVersion are read whole, see readLegacy().
+struct Serializer::SavedFile final {
+  struct Section final {
+    uint32_t count = 0;
+    kj::ArrayPtr<const kj::byte> bytes;
+    kj::Array<::capnp::word> words;  // Decompressed, Encoding::Compressed only.
+    std::unique_ptr<kj::ArrayInputStream> stream;
+    // Shared by all the sections of a legacy file.
+    std::shared_ptr<::capnp::MessageReader> message;
+  };
+
+  // A block of a compressed section, see BlockHeader.
+  struct Block final {
+    kj::ArrayPtr<const kj::byte> bytes;
+    kj::byte* out;
+    size_t size;
+  };
+
+  SavedFile(const std::string& filepath, const ::capnp::ReaderOptions& options)
+      : m_mapping(filepath), m_options(options) {
+    if (!m_mapping.isValid()) return;
+
+    const kj::ArrayPtr<const kj::byte> bytes = m_mapping.getBytes();
+    if (bytes.size() >= sizeof(FileHeader)) std::memcpy(&m_header, bytes.begin(), sizeof(FileHeader));
+    if ((m_header.magic != kMagic) && (m_header.magic != kPatchMagic)) {
+      readLegacy(bytes);
+      return;
+    }
+    // Sections of other versions may not be laid out the same.
+    if (m_header.version != kVersion) return;
+    if (m_header.encoding > static_cast<uint32_t>(Encoding::Compressed)) return;
+
+    if ((bytes.size() - sizeof(FileHeader)) / sizeof(SectionEntry) < m_header.sectionCount) return;
+    for (uint32_t i = 0; i < m_header.sectionCount; ++i) {
+      SectionEntry entry;
+      std::memcpy(&entry, bytes.begin() + sizeof(FileHeader) + i * sizeof(SectionEntry), sizeof(SectionEntry));
+      if ((entry.offset > bytes.size()) || (bytes.size() - entry.offset < entry.size)) return;
+
+      Section& section = m_sections[entry.type];
+      section.count = entry.count;
+      section.bytes = bytes.slice(entry.offset, entry.offset + entry.size);
+    }
+    m_valid = m_sections.find(kSymbolsSection) != m_sections.end();
+  }
+
+  // Patches (see SaveOptions::delta) are only valid when asked for.
+  bool isValid(bool patch = false) const { return m_valid && (isPatch() == patch); }
+
+  bool isPatch() const { return m_header.magic == kPatchMagic; }
+
+  // Reports saved files of a version that can't be restored.
+  void checkVersion(const std::string& filepath, const ErrorHandler& errorHandler) const {
+    if ((m_header.magic != kMagic) && (m_header.magic != kPatchMagic)) return;
+    if ((m_header.version == kVersion) || (m_header.version == kLegacyVersion)) return;
+    errorHandler(UHDM_UNSUPPORTED_FILE_VERSION,
+                 filepath + ": unsupported UHDM file version " + std::to_string(m_header.version) +
+                     ", only versions " + std::to_string(kLegacyVersion) + " and " + std::to_string(kVersion) +
+                     " can be restored",
+                 nullptr, nullptr);
+  }
+
+  uint32_t getCount(UhdmType type) const { return getCount(static_cast<uint32_t>(type)); }
+
+  uint32_t getCount(uint32_t type) const {
+    std::map<uint32_t, Section>::const_iterator it = m_sections.find(type);
+    return (it == m_sections.end()) ? 0 : it->second.count;
+  }
+
+  // Root of the message of the given section. Only valid for existing
+  // sections, see getCount().
+  UhdmRoot::Reader getRoot(uint32_t type) {
+    Section& section = m_sections.at(type);
+    if (!section.message) decode(section);
+    return section.message->getRoot<UhdmRoot>();
+  }
+
+  UhdmRoot::Reader getRoot(UhdmType type) { return getRoot(static_cast<uint32_t>(type)); }
+
+  // Decodes the messages of all sections, so that they can then be read
+  // from several threads.
+  void load(uint32_t threadCount) {
+    std::vector<Section*> sections;
+    for (auto& entry : m_sections) {
+      if ((entry.first != kPatchSection) && !entry.second.message) sections.emplace_back(&entry.second);
+    }
+    if (m_header.encoding == static_cast<uint32_t>(Encoding::Compressed)) {
+      // Blocks of all sections are spread over the threads, large sections
+      // included.
+      std::vector<Block> blocks;
+      for (Section* section : sections) getBlocks(*section, &blocks);
+      ThreadPool::parallelFor(threadCount, blocks.size(), [&](size_t i) { decompress(blocks[i]); });
+    }
+    ThreadPool::parallelFor(threadCount, sections.size(), [&](size_t i) { decode(*sections[i]); });
+  }
+
+  // Allocates the words the compressed section decompresses to and appends
+  // its blocks.
+  static void getBlocks(Section& section, std::vector<Block>* blocks) {
+    BlockHeader header;
+    KJ_REQUIRE(section.bytes.size() >= sizeof(header), "truncated compressed section");
+    std::memcpy(&header, section.bytes.begin(), sizeof(header));
+    KJ_REQUIRE((header.size % sizeof(::capnp::word) == 0) && (header.blockSize > 0) &&
+                   ((header.size + header.blockSize - 1) / header.blockSize == header.blockCount) &&
+                   ((section.bytes.size() - sizeof(header)) / sizeof(uint32_t) >= header.blockCount),
+               "malformed compressed section");
+
+    section.words = kj::heapArray<::capnp::word>(header.size / sizeof(::capnp::word));
+    kj::byte* const out = section.words.asBytes().begin();
+    size_t offset = sizeof(header) + header.blockCount * sizeof(uint32_t);
+    for (uint32_t i = 0; i < header.blockCount; ++i) {
+      uint32_t size;
+      std::memcpy(&size, section.bytes.begin() + sizeof(header) + i * sizeof(uint32_t), sizeof(size));
+      KJ_REQUIRE(section.bytes.size() - offset >= size, "truncated compressed section");
+      const uint64_t position = uint64_t(i) * header.blockSize;
+      blocks->emplace_back(Block{section.bytes.slice(offset, offset + size), out + position,
+                                 static_cast<size_t>(std::min<uint64_t>(header.blockSize, header.size - position))});
+      offset += size;
+    }
+  }
+
+  static void decompress(const Block& block) {
+    KJ_REQUIRE(BlockCodec::decompress(block.bytes.begin(), block.bytes.size(), block.out, block.size),
+               "corrupt compressed block");
+  }
+
+  void decode(Section& section) const {
+    if (m_header.encoding == static_cast<uint32_t>(Encoding::Compressed)) {
+      if (section.words == nullptr) {
+        std::vector<Block> blocks;
+        getBlocks(section, &blocks);
+        for (const Block& block : blocks) decompress(block);
+      }
+      section.message.reset(new ::capnp::FlatArrayMessageReader(
+          kj::ArrayPtr<const ::capnp::word>(section.words.begin(), section.words.size()), m_options));
+    } else if (m_header.encoding == static_cast<uint32_t>(Encoding::Flat)) {
+      // Cap'n Proto flat messages are sequences of 64-bit words. Mappings are
+      // page aligned and sections word aligned in the file, so the reader
+      // points straight into the mapped pages.
+      section.message.reset(new ::capnp::FlatArrayMessageReader(
+          kj::ArrayPtr<const ::capnp::word>(reinterpret_cast<const ::capnp::word*>(section.bytes.begin()),
+                                            section.bytes.size() / sizeof(::capnp::word)),
+          m_options));
+    } else {
+      section.stream.reset(new kj::ArrayInputStream(section.bytes));
+      section.message.reset(new ::capnp::PackedMessageReader(*section.stream, m_options));
+      // Stream readers read segments past the first one lazily, which isn't
+      // safe from several threads. Pull them all in now.
+      for (uint32_t id = 0; section.message->getSegment(id).begin() != nullptr; ++id) {
+      }
+    }
+  }
+
+  // Files without a header are the single message of kLegacyVersion, holding
+  // the objects of all types and the symbols. All the sections share it.
+  void readLegacy(kj::ArrayPtr<const kj::byte> bytes);
+
+  const MappedFile m_mapping;
+  const ::capnp::ReaderOptions m_options;
+  FileHeader m_header = {};
+  std::unique_ptr<kj::ArrayInputStream> m_legacyStream;  // Outlives the sections.
+  std::map<uint32_t, Section> m_sections;
+  bool m_valid = false;
+};
+
+// Calls visitor(static_cast<T*>(nullptr), getList) where getList(cap_root)
+// returns the capnp list that holds the objects of the given type.
+template <typename Visitor>
+static void dispatch(UhdmType type, Visitor&& visitor) {
+  switch (type) {
+<CAPNP_RESTORE_DISPATCH>
+    default: break;
+  }
 }
 
+// Types of the objects that files hold.
+static const UhdmType kSavedTypes[] = {
+<CAPNP_RESTORE_TYPES>
+};
+
+void Serializer::SavedFile::readLegacy(kj::ArrayPtr<const kj::byte> bytes) {
+  m_header = {};
+  try {
+    m_legacyStream.reset(new kj::ArrayInputStream(bytes));
+    std::shared_ptr<::capnp::MessageReader> message(new ::capnp::PackedMessageReader(*m_legacyStream, m_options));
+    // Pulled in at once, see decode().
+    for (uint32_t id = 0; message->getSegment(id).begin() != nullptr; ++id) {
+    }
+    const UhdmRoot::Reader root = message->getRoot<UhdmRoot>();
+    if (root.getVersion() != kLegacyVersion) return;
+
+    for (UhdmType type : kSavedTypes) {
+      dispatch(type, [&](auto*, auto getList) {
+        if (const uint32_t count = getList(root).size()) {
+          Section& section = m_sections[static_cast<uint32_t>(type)];
+          section.count = count;
+          section.message = message;
+        }
+      });
+    }
+    Section& symbols = m_sections[kSymbolsSection];
+    symbols.count = root.getSymbols().size();
+    symbols.message = message;
+  } catch (const kj::Exception&) {
+    // Not a saved file.
+    m_sections.clear();
+    return;
+  }
+  m_header = {kMagic, kLegacyVersion, static_cast<uint32_t>(Encoding::Packed), static_cast<uint32_t>(m_sections.size())};
+  m_valid = true;
+}
+
+// Whether objects of the given type are also of the base type.
+static bool isKindOf(UhdmType type, UhdmType base) {
+  switch (type) {
+<CAPNP_RESTORE_KIND_OF>
+    default: break;
+  }
+  return false;
+}
+
+// A patch saved with SaveOptions::delta, see Serializer::PatchHeader.
+struct Serializer::Patch final {
+  struct Entry final {
+    PatchEntry info;
+    std::vector<uint32_t> erased;
+    std::vector<uint32_t> written;
+
+    uint32_t getSurvivorCount() const { return info.snapshotCount - info.erasedCount; }
+
+    // Position in the snapshot of the surviving object at the given slot.
+    uint32_t getPosition(uint32_t slot) const {
+      for (uint32_t position : erased) {
+        if (position > slot) break;
+        ++slot;
+      }
+      return slot;
+    }
+
+    // Slot of the object at the given position in the snapshot, kBadIndex if
+    // it was erased.
+    uint32_t getSlot(uint32_t position) const {
+      std::vector<uint32_t>::const_iterator it = std::lower_bound(erased.cbegin(), erased.cend(), position);
+      if ((it != erased.cend()) && (*it == position)) return kBadIndex;
+      return position - static_cast<uint32_t>(it - erased.cbegin());
+    }
+  };
+
+  Patch(const std::string& filepath, const ::capnp::ReaderOptions& options) : m_file(filepath, options) {}
+
+  // Reads the kPatchSection, returns false if it is malformed or if the patch
+  // wasn't saved against the given snapshot.
+  bool read(const SavedFile &snapshot) {
+    std::map<uint32_t, SavedFile::Section>::const_iterator it = m_file.m_sections.find(kPatchSection);
+    if (it == m_file.m_sections.end()) return false;
+
+    kj::ArrayPtr<const kj::byte> bytes = it->second.bytes;
+    auto take = [&bytes](void *data, size_t size) {
+      if (bytes.size() < size) return false;
+      if (size > 0) std::memcpy(data, bytes.begin(), size);
+      bytes = bytes.slice(size, bytes.size());
+      return true;
+    };
+
+    PatchHeader header;
+    if (!take(&header, sizeof(header))) return false;
+    if (header.snapshotSymbolCount != snapshot.getCount(kSymbolsSection)) return false;
+
+    for (uint32_t i = 0; i < header.entryCount; ++i) {
+      Entry entry;
+      if (!take(&entry.info, sizeof(entry.info))) return false;
+      const PatchEntry &info = entry.info;
+      if ((info.snapshotCount != snapshot.getCount(info.type)) || (info.erasedCount > info.snapshotCount) ||
+          (info.writtenCount != m_file.getCount(info.type)) ||
+          (bytes.size() / sizeof(uint32_t) < uint64_t(info.erasedCount) + info.writtenCount)) {
+        return false;
+      }
+      entry.erased.resize(info.erasedCount);
+      entry.written.resize(info.writtenCount);
+      take(entry.erased.data(), entry.erased.size() * sizeof(uint32_t));
+      take(entry.written.data(), entry.written.size() * sizeof(uint32_t));
+
+      // Every object past the survivors is new, so written.
+      const uint32_t survivors = entry.getSurvivorCount();
+      const std::vector<uint32_t>::const_iterator created =
+          std::lower_bound(entry.written.cbegin(), entry.written.cend(), survivors);
+      if (!std::is_sorted(entry.erased.cbegin(), entry.erased.cend()) ||
+          !std::is_sorted(entry.written.cbegin(), entry.written.cend()) ||
+          (uint64_t(survivors) + (entry.written.cend() - created) != info.count) ||
+          (!entry.written.empty() && (entry.written.back() >= info.count)) ||
+          (!entry.erased.empty() && (entry.erased.back() >= info.snapshotCount))) {
+        return false;
+      }
+      m_entries.emplace(static_cast<UhdmType>(info.type), std::move(entry));
+    }
+    return true;
+  }
+
+  const Entry *find(UhdmType type) const {
+    std::map<UhdmType, Entry>::const_iterator it = m_entries.find(type);
+    return (it == m_entries.end()) ? nullptr : &it->second;
+  }
+
+  // Objects of the given type once patched.
+  uint32_t getCount(const SavedFile &snapshot, UhdmType type) const {
+    const Entry *const entry = find(type);
+    return (entry == nullptr) ? snapshot.getCount(type) : entry->info.count;
+  }
+
+  // Slot once patched of the object at the given position in the snapshot.
+  uint32_t getSlot(UhdmType type, uint32_t position) const {
+    const Entry *const entry = find(type);
+    return (entry == nullptr) ? position : entry->getSlot(position);
+  }
+
+  SavedFile m_file;
+  std::map<UhdmType, Entry> m_entries;
+};
+
 struct Serializer::RestoreAdapter {
-  void operator()(::Any::Reader reader, Serializer *const serializer, BaseClass *const obj) const {
+  using collections_t = std::vector<std::pair<UhdmType, Factory::objects_t*>>;
+
+  // Objects are filled in ranges of this many consecutive objects of a type.
+  static constexpr uint32_t kRangeSize = 4096;
+
+  // When set, created collections are held here and constructed in
+  // m_collectionStorage instead of being handed to their factory, so that
+  // ranges can be filled concurrently. See restore().
+  collections_t *m_collections = nullptr;
+  SlabAllocator *m_collectionStorage = nullptr;
+
+  // When set, objects are read from the snapshot a patch applies to, and the
+  // indices they refer to are positions in the snapshot.
+  const Patch *m_remap = nullptr;
+
+  template <typename T>
+  T *getObject(Serializer *const serializer, uint32_t type, uint32_t index) const {
+    if ((m_remap != nullptr) && (index != kBadIndex)) index = m_remap->getSlot(static_cast<UhdmType>(type), index);
+    return serializer->getObject<T>(type, index);
+  }
+
+  template <typename T>
+  std::vector<T*> *makeCollection(Serializer *const serializer) const {
+    if (m_collections == nullptr) return serializer->makeCollection<T>();
+    std::vector<T*> *const collection =
+        new (m_collectionStorage->allocate(sizeof(std::vector<T*>))) std::vector<T*>;
+    m_collections->emplace_back(T::kUhdmType, (Factory::objects_t*)collection);
+    return collection;
+  }
+
+  // The ids of a file are those of the restored symbol table, see
+  // restoreSymbols(), symbols are set without being looked up.
+  static SymbolId getSymbolId(Serializer *const serializer, RawSymbolId id) {
+    const SymbolFactory &symbolFactory = serializer->m_symbolFactory;
+    return (id < symbolFactory.getSymbolCount()) ? SymbolId(id, symbolFactory.getOwnSymbol(id)) : BadSymbolId;
+  }
+
+  void restoreProperties(::Any::Reader reader, Serializer *const serializer, BaseClass *const obj) const {
     // Do NOT call VpiParent function call here! It ends up duplicating the entries in the collections
     // because of calls to OnChildAdded & OnChildRemoved.
     // obj->VpiParent(serializer->getObject(reader.getVpiParent().getType(), reader.getVpiParent().getIndex() - 1));
-    obj->m_parent = serializer->getObject<BaseClass>(reader.getParent().getType(), reader.getParent().getIndex() - 1);
-    obj->setFile(serializer->m_symbolFactory.getSymbol(SymbolId(reader.getFile(), kUnknownRawSymbol)));
+    obj->m_parent = getObject<BaseClass>(serializer, reader.getParent().getType(), reader.getParent().getIndex() - 1);
+    obj->m_fileId = getSymbolId(serializer, reader.getFile());
     obj->m_startLine = reader.getStartLine();
     obj->m_startColumn = reader.getStartColumn();
     obj->m_endLine = reader.getEndLine();
@@ -73,51 +497,518 @@ struct Serializer::RestoreAdapter {
     obj->m_uhdmId = reader.getUhdmId();
   }
 
+  void restoreRelations(::Any::Reader reader, Serializer *const serializer, BaseClass *const obj) const {
+  }
+
 <CAPNP_RESTORE_ADAPTERS>
-  template<typename T, typename U, typename = typename std::enable_if<std::is_base_of<BaseClass, T>::value>::type>
-  void operator()(typename ::capnp::List<U>::Reader reader, Serializer *serializer) const {
-    Factory::objects_t& objects = serializer->m_factories[T::kUhdmType]->m_objects;
-    uint32_t index = 0;
-    for (typename U::Reader subReader : reader)
-      operator()(subReader, serializer, any_cast<T>(objects[index++]));
+  template <typename Reader, typename T>
+  void restoreObject(Reader reader, Serializer *const serializer, T *const obj, bool modified) const {
+    restoreProperties(reader, serializer, obj);
+    restoreRelations(reader, serializer, obj);
+    obj->m_modified = modified;
+  }
+
+  // Fills the already created objects [begin, end) of the given type. With a
+  // patch, the objects it holds are read from it and the others from the
+  // snapshot.
+  void fill(SavedFile &file, Patch *const patch, Serializer *const serializer, UhdmType type, uint32_t begin,
+            uint32_t end) const {
+    const Factory::objects_t& objects = serializer->m_factories.at(type)->m_objects;
+    const Patch::Entry *const entry = (patch == nullptr) ? nullptr : patch->find(type);
+    RestoreAdapter fromSnapshot = *this;
+    fromSnapshot.m_remap = patch;
+    dispatch(type, [&](auto *tag, auto getList) {
+      using T = std::remove_pointer_t<decltype(tag)>;
+      if (entry == nullptr) {
+        const auto list = getList(file.getRoot(type));
+        for (uint32_t index = begin; index < end; ++index) {
+          fromSnapshot.restoreObject(list[index], serializer, any_cast<T>(objects[index]), false);
+        }
+        return;
+      }
+
+      // Objects are never reordered: the survivors of the snapshot come
+      // first, in the same order, then the new ones.
+      decltype(getList(file.getRoot(type))) snapshotList, patchList;
+      if (entry->info.snapshotCount > 0) snapshotList = getList(file.getRoot(type));
+      if (entry->info.writtenCount > 0) patchList = getList(patch->m_file.getRoot(type));
+
+      const uint32_t survivors = entry->getSurvivorCount();
+      std::vector<uint32_t>::const_iterator written =
+          std::lower_bound(entry->written.cbegin(), entry->written.cend(), begin);
+      uint32_t position = entry->getPosition(begin);
+      std::vector<uint32_t>::const_iterator erased =
+          std::upper_bound(entry->erased.cbegin(), entry->erased.cend(), position);
+      for (uint32_t index = begin; index < end; ++index) {
+        T *const obj = any_cast<T>(objects[index]);
+        if ((written != entry->written.cend()) && (*written == index)) {
+          restoreObject(patchList[static_cast<uint32_t>(written - entry->written.cbegin())], serializer, obj, true);
+          ++written;
+        } else {
+          fromSnapshot.restoreObject(snapshotList[position], serializer, obj, false);
+        }
+        if (index < survivors) {
+          ++position;
+          for (; (erased != entry->erased.cend()) && (*erased == position); ++erased) ++position;
+        }
+      }
+    });
   }
+
+  static void restoreSymbols(SavedFile &file, Serializer *const serializer);
+  static std::vector<vpiHandle> restore(SavedFile &file, Patch *const patch, Serializer *const serializer,
+                                        uint32_t threadCount);
+  static std::vector<vpiHandle> restoreLazy(Serializer *const serializer);
+  static std::vector<vpiHandle> restoreSelected(const std::string &filepath, const ::capnp::ReaderOptions &readerOptions,
+                                                Serializer *const serializer, const RestoreOptions &options);
 };
 
-const std::vector<vpiHandle> Serializer::restore(const std::filesystem::path& filepath) {
-    return restore( filepath.string());
+// State of a lazy restore. Objects are created on first reference with their
+// properties and parent, and flagged so that their relations get restored on
+// first access (see BaseClass::materialize).
+struct Serializer::LazyRestore final {
+  LazyRestore(const std::string& filepath, const ::capnp::ReaderOptions& options) : m_file(filepath, options) {}
+
+  BaseClass* get(Serializer *const serializer, UhdmType type, uint32_t index) {
+    std::vector<BaseClass*>& objects = m_objects[type];
+    if (objects.empty()) objects.resize(m_file.getCount(type), nullptr);
+    if (index >= objects.size()) return nullptr;
+
+    BaseClass *object = objects[index];
+    if (object == nullptr) {
+      dispatch(type, [&](auto *tag, auto getList) {
+        using T = std::remove_pointer_t<decltype(tag)>;
+        T *const obj = serializer->m_factories[type]->template make<T>();
+        obj->setSerializer(serializer);
+        obj->m_pendingRestore = true;
+        // Register before restoring the properties, the parent chain may lead
+        // back to this object.
+        objects[index] = object = obj;
+        ++m_createdCounts[type];
+        m_pending.emplace(obj, index);
+        ++m_depth;
+        RestoreAdapter().restoreProperties(getList(m_file.getRoot(type))[index], serializer, obj);
+        obj->m_modified = false;
+        --m_depth;
+      });
+    }
+    // Parents are only reached through restoreProperties().
+    if ((m_reached != nullptr) && (m_depth == 0)) m_reached->emplace_back(object);
+    return object;
+  }
+
+  void materialize(Serializer *const serializer, BaseClass *const object) {
+    object->m_pendingRestore = false;
+    auto it = m_pending.find(object);
+    if (it == m_pending.end()) return;
+
+    const uint32_t index = it->second;
+    m_pending.erase(it);
+    // The object may have been modified before its relations got restored.
+    const bool modified = object->m_modified;
+    dispatch(object->getUhdmType(), [&](auto *tag, auto getList) {
+      using T = std::remove_pointer_t<decltype(tag)>;
+      RestoreAdapter().restoreRelations(getList(m_file.getRoot(object->getUhdmType()))[index], serializer,
+                                        static_cast<T*>(object));
+    });
+    object->m_modified = modified;
+  }
+
+  void materializeAll(Serializer *const serializer) {
+    for (factories_t::const_reference entry : serializer->m_factories) {
+      for (uint32_t i = 0, n = m_file.getCount(entry.first); i < n; ++i) get(serializer, entry.first, i);
+    }
+    for (auto &entry : m_objects) {
+      for (BaseClass *const object : entry.second) {
+        if ((object != nullptr) && object->m_pendingRestore) materialize(serializer, object);
+      }
+    }
+
+    // Objects were made in the order they were reached. Put them back in
+    // file order, ahead of the ones made since, for the baseline to match
+    // the file (see Factory::getBaselineSurvivorCount).
+    for (auto &entry : m_objects) {
+      Factory *const factory = serializer->m_factories[entry.first];
+      const std::vector<BaseClass*> &restored = entry.second;
+      if (factory->m_objects.size() == restored.size()) {
+        factory->m_objects.assign(restored.cbegin(), restored.cend());
+      } else {
+        const std::unordered_set<const BaseClass*> fromFile(restored.cbegin(), restored.cend());
+        Factory::objects_t ordered(restored.cbegin(), restored.cend());
+        for (BaseClass *const object : factory->m_objects) {
+          if (fromFile.find(object) == fromFile.cend()) ordered.emplace_back(object);
+        }
+        factory->m_objects.swap(ordered);
+      }
+      factory->updateSlots(0);
+    }
+  }
+
+  SavedFile m_file;
+
+  // Created objects by type, indexed by their position in the file.
+  std::map<UhdmType, std::vector<BaseClass*>> m_objects;
+  std::map<UhdmType, uint32_t> m_createdCounts;
+
+  // Created objects whose relations are yet to be restored.
+  std::unordered_map<const BaseClass*, uint32_t> m_pending;
+
+  // When set, objects referenced by a relation are recorded here, see
+  // RestoreAdapter::restoreSelected().
+  std::vector<BaseClass*> *m_reached = nullptr;
+  uint32_t m_depth = 0;
+};
+
+void Serializer::LazyRestoreDeleter::operator()(LazyRestore* lazyRestore) const {
+  delete lazyRestore;
 }
-const std::vector<vpiHandle> Serializer::restore(const std::string& filepath) {
-  purge();
-  std::vector<vpiHandle> designs;
-  const std::string file = filepath;
-  int32_t fileid = open(file.c_str(), O_RDONLY | O_BINARY);
-  ::capnp::ReaderOptions options;
-  options.traversalLimitInWords = ULLONG_MAX;
-  options.nestingLimit = 1024;
-  ::capnp::PackedFdMessageReader message(fileid, options);
-  UhdmRoot::Reader cap_root = message.getRoot<UhdmRoot>();
-  m_version = cap_root.getVersion();
-  if (m_version != kVersion) return designs;
 
-  const ::capnp::List<::capnp::Text>::Reader& symbols = cap_root.getSymbols();
-  for (const auto& symbol : symbols) {
-    m_symbolFactory.registerSymbol(symbol.cStr());
+template<typename T>
+T* Serializer::getObject(uint32_t type, uint32_t index) const {
+  if (index == kBadIndex) {
+    return nullptr;
+  }
+
+  if (m_lazyRestore) {
+    return any_cast<T>(m_lazyRestore->get(const_cast<Serializer*>(this), static_cast<UhdmType>(type), index));
   }
 
+  factories_t::const_iterator it = m_factories.find(static_cast<UhdmType>(type));
+  return it != m_factories.cend() ? any_cast<T>(it->second->m_objects[index]) : nullptr;
+}
+
+void Serializer::materialize(BaseClass* object) {
+  if (m_lazyRestore) {
+    m_lazyRestore->materialize(this, object);
+  } else {
+    object->m_pendingRestore = false;
+  }
+}
+
+uint32_t Serializer::getPendingObjectCount(UhdmType type) const {
+  if (!m_lazyRestore) return 0;
+  std::map<UhdmType, uint32_t>::const_iterator it = m_lazyRestore->m_createdCounts.find(type);
+  return m_lazyRestore->m_file.getCount(type) - ((it == m_lazyRestore->m_createdCounts.end()) ? 0 : it->second);
+}
+
+void Serializer::materializeAll() {
+  if (!m_lazyRestore) return;
+  m_lazyRestore->materializeAll(this);
+  m_lazyRestore.reset();
+}
+
+void Serializer::RestoreAdapter::restoreSymbols(SavedFile &file, Serializer *const serializer) {
+  const ::capnp::List<::capnp::Text>::Reader& list = file.getRoot(kSymbolsSection).getSymbols();
+  std::vector<std::string_view> symbols;
+  symbols.reserve(list.size());
+  for (const auto& symbol : list) symbols.emplace_back(symbol.cStr(), symbol.size());
+  // Files start with the bad symbol, the table already has it.
+  const size_t from = (!symbols.empty() && (symbols.front() == SymbolFactory::getBadSymbol())) ? 1 : 0;
+  serializer->m_symbolFactory.appendUnique(symbols.data() + from, symbols.size() - from);
+}
+
+std::vector<vpiHandle> Serializer::RestoreAdapter::restore(SavedFile &file, Patch *const patch,
+                                                           Serializer *const serializer, uint32_t threadCount) {
+  std::vector<vpiHandle> designs;
+  restoreSymbols(file, serializer);
+  file.load(threadCount);
+  if (patch != nullptr) {
+    // The symbols made since the snapshot get the ids that follow.
+    restoreSymbols(patch->m_file, serializer);
+    patch->m_file.load(threadCount);
+  }
+
+  auto getCount = [&](UhdmType type) {
+    return (patch == nullptr) ? file.getCount(type) : patch->getCount(file, type);
+  };
 <CAPNP_INIT_FACTORIES>
   // This assignment should happen only after the necessary objects are created.
-  m_objId = cap_root.getObjectId();
+  serializer->m_objId = ((patch == nullptr) ? file : patch->m_file).getRoot(kSymbolsSection).getObjectId();
+
+  struct Range final {
+    UhdmType type;
+    uint32_t begin;
+    uint32_t end;
+  };
+  std::vector<Range> ranges;
+  for (factories_t::const_reference entry : serializer->m_factories) {
+    for (uint32_t begin = 0, n = getCount(entry.first); begin < n; begin += kRangeSize) {
+      ranges.emplace_back(Range{entry.first, begin, std::min(n, begin + kRangeSize)});
+    }
+  }
+
+  if (threadCount == 0) threadCount = std::max(1U, std::thread::hardware_concurrency());
+  if ((threadCount == 1) || (ranges.size() < 2)) {
+    RestoreAdapter adapter;
+    for (const Range &range : ranges) {
+      adapter.fill(file, patch, serializer, range.type, range.begin, range.end);
+    }
+  } else {
+    // A range only writes to its own objects and only reads from the message,
+    // the factories and the symbol table. Every symbol of the file is already
+    // registered, so setting a symbol is a lookup. Collections are the only
+    // shared allocations, they are handed to their factories once all ranges
+    // are done.
+    std::vector<collections_t> collections(ranges.size());
+    std::vector<SlabAllocator> collectionStorage(ranges.size());
+    auto adoptCollections = [&]() {
+      for (collections_t &rangeCollections : collections) {
+        for (collections_t::const_reference entry : rangeCollections) {
+          serializer->m_factories[entry.first]->m_collections.emplace_back(entry.second);
+        }
+      }
+      for (SlabAllocator &storage : collectionStorage) serializer->m_collectionStorage.adopt(storage);
+    };
 
-  RestoreAdapter adapter;
-<CAPNP_RESTORE_FACTORIES>
+    ThreadPool pool(std::min<uint32_t>(threadCount, static_cast<uint32_t>(ranges.size())));
+    for (size_t i = 0, n = ranges.size(); i < n; ++i) {
+      pool.submit([&, i]() {
+        RestoreAdapter adapter;
+        adapter.m_collections = &collections[i];
+        adapter.m_collectionStorage = &collectionStorage[i];
+        adapter.fill(file, patch, serializer, ranges[i].type, ranges[i].begin, ranges[i].end);
+      });
+    }
+    try {
+      pool.wait();
+    } catch (...) {
+      adoptCollections();
+      throw;
+    }
+    adoptCollections();
+  }
 
-  Factory* const designFactory = m_factories[UhdmType::Design];
+  Factory* const designFactory = serializer->m_factories[UhdmType::Design];
   for (auto d : designFactory->m_objects) {
-    vpiHandle designH = m_uhdmHandleFactory.make(UhdmType::Design, d);
+    vpiHandle designH = serializer->m_uhdmHandleFactory.make(UhdmType::Design, d);
     designs.emplace_back(designH);
   }
 
-  close(fileid);
+  // The restored file is the baseline, patched or not. Objects read from the
+  // patch are flagged as modified already.
+  for (factories_t::const_reference entry : serializer->m_factories) {
+    const Patch::Entry *const patchEntry = (patch == nullptr) ? nullptr : patch->find(entry.first);
+    entry.second->m_baselineCount = file.getCount(entry.first);
+    if (patchEntry == nullptr) {
+      entry.second->m_erasedFromBaseline.clear();
+    } else {
+      entry.second->m_erasedFromBaseline = patchEntry->erased;
+    }
+  }
+  serializer->m_baselineSymbolCount = file.getCount(kSymbolsSection);
+  serializer->m_baselineSymbolIds.clear();
+  serializer->m_hasBaseline = true;
+  return designs;
+}
+
+std::vector<vpiHandle> Serializer::RestoreAdapter::restoreLazy(Serializer *const serializer) {
+  std::vector<vpiHandle> designs;
+  SavedFile &file = serializer->m_lazyRestore->m_file;
+  restoreSymbols(file, serializer);
+
+  // Objects are created straight from their factories, without new ids.
+  serializer->m_objId = file.getRoot(kSymbolsSection).getObjectId();
+
+  // Factories get back in file order once everything is materialized, see
+  // LazyRestore::materializeAll().
+  for (factories_t::const_reference entry : serializer->m_factories) {
+    entry.second->m_baselineCount = file.getCount(entry.first);
+  }
+  serializer->m_baselineSymbolCount = file.getCount(kSymbolsSection);
+  serializer->m_baselineSymbolIds.clear();
+  serializer->m_hasBaseline = true;
+
+  for (uint32_t i = 0, n = file.getCount(UhdmType::Design); i < n; ++i) {
+    BaseClass* const d = serializer->getObject<Design>(static_cast<uint32_t>(UhdmType::Design), i);
+    designs.emplace_back(serializer->m_uhdmHandleFactory.make(UhdmType::Design, d));
+  }
   return designs;
 }
+
+// Follows a dotted hierarchical path from the top modules of the designs.
+static const BaseClass* findInstance(Serializer *const serializer, const std::vector<vpiHandle>& designs,
+                                     std::string_view path) {
+  std::string_view name = path.substr(0, path.find('.'));
+  path.remove_prefix(std::min(path.size(), name.size() + 1));
+  // Top modules may be prefixed by their library.
+  if (std::string_view::size_type pos = name.find('@'); pos != std::string_view::npos) name.remove_prefix(pos + 1);
+
+  const BaseClass* instance = nullptr;
+  for (vpiHandle design : designs) {
+    const Design *const d = (const Design*)((const uhdm_handle*)design)->object;
+    if (d->getTopModules() == nullptr) continue;
+    for (const Module *m : *d->getTopModules()) {
+      if (m->getName() == name) instance = m;
+    }
+  }
+
+  while ((instance != nullptr) && !path.empty()) {
+    name = path.substr(0, path.find('.'));
+    path.remove_prefix(std::min(path.size(), name.size() + 1));
+    instance = instance->getByVpiName(name);
+  }
+  return instance;
+}
+
+std::vector<vpiHandle> Serializer::RestoreAdapter::restoreSelected(const std::string &filepath,
+                                                                   const ::capnp::ReaderOptions &readerOptions,
+                                                                   Serializer *const serializer,
+                                                                   const RestoreOptions &options) {
+  // The selection is restored on top of a lazy restore: only reached objects
+  // are ever created.
+  auto start = [&]() {
+    std::unique_ptr<LazyRestore, LazyRestoreDeleter> lazyRestore(new LazyRestore(filepath, readerOptions));
+    serializer->m_version = lazyRestore->m_file.m_header.version;
+    if (!lazyRestore->m_file.isValid()) {
+      lazyRestore->m_file.checkVersion(filepath, serializer->m_errorHandler);
+      return std::vector<vpiHandle>();
+    }
+    serializer->m_lazyRestore = std::move(lazyRestore);
+    return restoreLazy(serializer);
+  };
+
+  std::vector<vpiHandle> designs = start();
+  if (!serializer->m_lazyRestore) return {};
+
+  std::vector<std::pair<UhdmType, uint32_t>> roots;
+  for (std::map<uint32_t, SavedFile::Section>::const_reference entry : serializer->m_lazyRestore->m_file.m_sections) {
+    if (entry.first == kSymbolsSection) continue;
+    const UhdmType type = static_cast<UhdmType>(entry.first);
+    if (std::any_of(options.types.cbegin(), options.types.cend(),
+                    [type](UhdmType base) { return isKindOf(type, base); })) {
+      for (uint32_t i = 0; i < entry.second.count; ++i) roots.emplace_back(type, i);
+    }
+  }
+
+  if (!options.instancePath.empty()) {
+    // Finding the instance creates every object on the way, start over once
+    // its position in the file is known.
+    if (const BaseClass *const instance = findInstance(serializer, designs, options.instancePath)) {
+      const std::vector<BaseClass*> &objects = serializer->m_lazyRestore->m_objects[instance->getUhdmType()];
+      roots.emplace_back(instance->getUhdmType(),
+                         static_cast<uint32_t>(std::find(objects.cbegin(), objects.cend(), instance) - objects.cbegin()));
+    }
+    serializer->purge();
+    start();
+    if (!serializer->m_lazyRestore) return {};
+  }
+
+  LazyRestore &lazyRestore = *serializer->m_lazyRestore;
+  std::vector<vpiHandle> selected;
+  std::vector<BaseClass*> reached;
+  lazyRestore.m_reached = &reached;
+  for (std::vector<std::pair<UhdmType, uint32_t>>::const_reference root : roots) {
+    BaseClass *const object = lazyRestore.get(serializer, root.first, root.second);
+    selected.emplace_back(serializer->m_uhdmHandleFactory.make(root.first, object));
+  }
+  while (!reached.empty()) {
+    BaseClass *const object = reached.back();
+    reached.pop_back();
+    if (object->m_pendingRestore) lazyRestore.materialize(serializer, object);
+  }
+  lazyRestore.m_reached = nullptr;
+
+  // What is left pending are the parents, they keep their relations empty.
+  for (std::unordered_map<const BaseClass*, uint32_t>::const_reference entry : lazyRestore.m_pending) {
+    const_cast<BaseClass*>(entry.first)->m_pendingRestore = false;
+  }
+  serializer->m_lazyRestore.reset();
+
+  // Only part of the file is there, deltas can't be saved against it and the
+  // parents would collect it as garbage.
+  for (factories_t::const_reference entry : serializer->m_factories) {
+    entry.second->m_baselineCount = 0;
+  }
+  serializer->m_hasBaseline = false;
+  serializer->m_partial = true;
+  return selected;
+}
+
+bool Serializer::readFileInfo(const std::filesystem::path& filepath, FileInfo* info) {
+  // Legacy files are read whole.
+  ::capnp::ReaderOptions readerOptions;
+  readerOptions.traversalLimitInWords = ULLONG_MAX;
+  const SavedFile file(filepath.string(), readerOptions);
+  if ((file.m_header.magic != kMagic) && (file.m_header.magic != kPatchMagic)) return false;
+
+  *info = FileInfo();
+  info->version = file.m_header.version;
+  info->encoding = static_cast<Encoding>(file.m_header.encoding);
+  info->patch = file.isPatch();
+  if ((file.m_header.version != kVersion) && !file.isValid(info->patch)) return true;
+  if (!file.isValid(info->patch)) return false;
+
+  info->symbolCount = file.getCount(kSymbolsSection);
+  for (std::map<uint32_t, SavedFile::Section>::const_reference entry : file.m_sections) {
+    if ((entry.first != kSymbolsSection) && (entry.first != kPatchSection)) {
+      info->objectStats.emplace(UhdmName(static_cast<UhdmType>(entry.first)), entry.second.count);
+    }
+  }
+  return true;
+}
+
+const std::vector<vpiHandle> Serializer::restore(const std::filesystem::path& filepath) {
+  return restore(filepath.string());
+}
+
+const std::vector<vpiHandle> Serializer::restore(const std::string& filepath) {
+  return restore(filepath, RestoreOptions());
+}
+
+const std::vector<vpiHandle> Serializer::restore(const std::filesystem::path& filepath,
+                                                 const RestoreOptions& options) {
+  return restore(filepath.string(), options);
+}
+
+const std::vector<vpiHandle> Serializer::restore(const std::string& filepath, const RestoreOptions& options) {
+  purge();
+  ::capnp::ReaderOptions readerOptions;
+  readerOptions.traversalLimitInWords = ULLONG_MAX;
+  readerOptions.nestingLimit = 1024;
+
+  if (!options.patch.empty()) {
+    Patch patch(options.patch, readerOptions);
+    if (!patch.m_file.isValid(true)) {
+      // A full save, restored on its own.
+      m_version = patch.m_file.m_header.version;
+      if (!patch.m_file.isValid()) {
+        patch.m_file.checkVersion(options.patch, m_errorHandler);
+        return {};
+      }
+      return RestoreAdapter::restore(patch.m_file, nullptr, this, options.threads);
+    }
+
+    SavedFile file(filepath, readerOptions);
+    m_version = file.m_header.version;
+    if (!file.isValid()) {
+      file.checkVersion(filepath, m_errorHandler);
+      return {};
+    }
+    if (!patch.read(file)) return {};
+    return RestoreAdapter::restore(file, &patch, this, options.threads);
+  }
+
+  if (!options.types.empty() || !options.instancePath.empty()) {
+    return RestoreAdapter::restoreSelected(filepath, readerOptions, this, options);
+  }
+
+  if (options.lazy) {
+    std::unique_ptr<LazyRestore, LazyRestoreDeleter> lazyRestore(new LazyRestore(filepath, readerOptions));
+    m_version = lazyRestore->m_file.m_header.version;
+    if (!lazyRestore->m_file.isValid()) {
+      lazyRestore->m_file.checkVersion(filepath, m_errorHandler);
+      return {};
+    }
+    m_lazyRestore = std::move(lazyRestore);
+    return RestoreAdapter::restoreLazy(this);
+  }
+
+  SavedFile file(filepath, readerOptions);
+  m_version = file.m_header.version;
+  if (!file.isValid()) {
+    file.checkVersion(filepath, m_errorHandler);
+    return {};
+  }
+  return RestoreAdapter::restore(file, nullptr, this, options.threads);
+}
 }  // namespace uhdm
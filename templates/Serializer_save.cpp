@@ -34,14 +34,22 @@
   #include <unistd.h>
 #endif
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <numeric>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <capnp/message.h>
 #include <capnp/serialize-packed.h>
+#include <capnp/serialize.h>
 
 #include "UHDM.capnp.h"
+#include <uhdm/BlockCodec.h>
+#include <uhdm/ThreadPool.h>
 #include <uhdm/containers.h>
 #include <uhdm/uhdm.h>
 #include <uhdm/uhdm_types.h>
@@ -49,19 +57,70 @@
 #include "uhdm/config.h"
 
 namespace uhdm {
-inline static uint32_t getId(const BaseClass* p, const Serializer::IdMap &idMap) {
-  auto it = idMap.find(p);
-  return (it == idMap.end()) ? Serializer::kBadIndex : it->second;
+// Calls visitor(static_cast<T*>(nullptr), init) where init(cap_root, n)
+// creates the capnp list that holds the n objects of the given type.
+template <typename Visitor>
+static void dispatch(UhdmType type, Visitor&& visitor) {
+  switch (type) {
+<CAPNP_SAVE_DISPATCH>
+    default: break;
+  }
+}
+
+static void writeBytes(int32_t fileid, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const auto written = write(fileid, bytes, static_cast<uint32_t>(std::min<size_t>(size, 1 << 30)));
+    if (written <= 0) return;
+    bytes += written;
+    size -= written;
+  }
 }
 
 struct Serializer::SaveAdapter {
-  void operator()(const BaseClass *const obj, Serializer *const serializer, const IdMap& idMap, ::Any::Builder builder) const {
+  // Saved indices are 1-based, 0 stands for null. Sections list the objects of
+  // a type in factory order, so the index of an object is its slot. A
+  // reference left to an object erased since, or of another serializer, is
+  // saved as null.
+  uint32_t getId(const BaseClass *const p) const {
+    if (p->getSerializer() != m_serializer) return 0;
+    const uint32_t type = static_cast<uint32_t>(p->getUhdmType());
+    if ((type >= m_objects.size()) || (m_objects[type] == nullptr)) return 0;
+    const Factory::objects_t &objects = *m_objects[type];
+    const uint32_t slot = p->getSlot();
+    return ((slot < objects.size()) && (objects[slot] == p)) ? slot + 1 : 0;
+  }
+
+  // Indexes the objects of the factories by type, for getId(). Run once the
+  // factories are compacted.
+  void indexObjects(Serializer *const serializer) {
+    m_serializer = serializer;
+    for (factories_t::const_reference entry : serializer->m_factories) {
+      const uint32_t type = static_cast<uint32_t>(entry.first);
+      if (type >= m_objects.size()) m_objects.resize(type + 1, nullptr);
+      m_objects[type] = &entry.second->m_objects;
+    }
+  }
+
+  // Computes the properties that are created on first access, making symbols
+  // on the way (see getFullName). Run before the symbols are numbered, so
+  // that encoding only reads the symbol table.
+  void prepare(const BaseClass *const obj) const {
+  }
+
+  // Id in the file of a symbol, see mapSymbols().
+  RawSymbolId getSymbolId(SymbolId id) const {
+    const RawSymbolId rid = (RawSymbolId)id;
+    return (rid < m_symbolIds.size()) ? m_symbolIds[rid] : BadRawSymbolId;
+  }
+
+  void operator()(const BaseClass *const obj, Serializer *const serializer, ::Any::Builder builder) const {
     if (obj->m_parent != nullptr) {
       ::ObjIndexType::Builder parentBuilder = builder.getParent();
-      parentBuilder.setIndex(getId(obj->getParent(), idMap));
+      parentBuilder.setIndex(getId(obj->getParent()));
       parentBuilder.setType(static_cast<uint32_t>(obj->m_parent->getUhdmType()));
     }
-    builder.setFile((RawSymbolId)obj->getSerializer()->m_symbolFactory.registerSymbol(obj->getFile()));
+    builder.setFile(getSymbolId(obj->m_fileId));
     builder.setStartLine(obj->m_startLine);
     builder.setStartColumn(obj->m_startColumn);
     builder.setEndLine(obj->m_endLine);
@@ -71,14 +130,232 @@ struct Serializer::SaveAdapter {
 
 <CAPNP_SAVE_ADAPTERS>
 
-  template<typename T, typename U, typename = typename std::enable_if<std::is_base_of<BaseClass, T>::value>::type>
-  void operator()(Serializer* const serializer, const Serializer::IdMap& idMap,
-                  typename ::capnp::List<U>::Builder builder) const {
-    const Factory* const factory = serializer->m_factories[T::kUhdmType];
+  using sections_t = std::vector<std::pair<UhdmType, const Factory::objects_t*>>;
+
+  // Objects of one type written to a patch, see SaveOptions::delta.
+  struct Change final {
+    PatchEntry entry;
+    std::vector<uint32_t> erased;
+    std::vector<uint32_t> written;
+    Factory::objects_t objects;  // At the written slots.
+  };
+
+  // Collects the objects created or modified since the baseline. Objects past
+  // the survivors of the baseline are all new.
+  void collectChanges(Serializer *const serializer) {
+    for (factories_t::const_reference entry : serializer->m_factories) {
+      const Factory *const factory = entry.second;
+      const uint32_t survivors = factory->getBaselineSurvivorCount();
+      Change change;
+      for (uint32_t slot = 0, n = static_cast<uint32_t>(factory->m_objects.size()); slot < n; ++slot) {
+        BaseClass *const obj = factory->m_objects[slot];
+        if ((slot >= survivors) || obj->m_modified) {
+          change.written.emplace_back(slot);
+          change.objects.emplace_back(obj);
+        }
+      }
+      if (change.written.empty() && factory->m_erasedFromBaseline.empty()) continue;
+
+      change.erased = factory->m_erasedFromBaseline;
+      change.entry = PatchEntry{static_cast<uint32_t>(entry.first), factory->m_baselineCount,
+                                static_cast<uint32_t>(factory->m_objects.size()),
+                                static_cast<uint32_t>(change.erased.size()),
+                                static_cast<uint32_t>(change.written.size())};
+      m_changes.emplace_back(std::move(change));
+    }
+  }
+
+  // Encodes the given objects of a type in a message of their own and
+  // appends it to the file as a section.
+  void saveSection(Serializer *const serializer, UhdmType type, const Factory::objects_t &objects) {
+    ::capnp::MallocMessageBuilder message;
+    UhdmRoot::Builder cap_root = message.initRoot<UhdmRoot>();
+    cap_root.setVersion(kVersion);
+    cap_root.setObjectId(serializer->m_objId);
+    dispatch(type, [&](auto *tag, auto init) {
+      using T = std::remove_pointer_t<decltype(tag)>;
+      auto builder = init(cap_root, static_cast<uint32_t>(objects.size()));
+      uint32_t index = 0;
+      for (const BaseClass *obj : objects) {
+        operator()(any_cast<T>(obj), serializer, builder[index++]);
+      }
+    });
+    writeSection(static_cast<uint32_t>(type), static_cast<uint32_t>(objects.size()), message);
+  }
+
+  // Numbers the symbols in the file, see SaveOptions::compactSymbols. A full
+  // save keeps the ids of the serializer, or when compact, numbers the
+  // symbols of the objects in the order of their text. A patch keeps the ids
+  // of its snapshot and numbers the symbols it doesn't have after them.
+  void mapSymbols(Serializer *const serializer, const sections_t &sections, bool delta, bool compact) {
+    const SymbolFactory &symbolFactory = serializer->m_symbolFactory;
+    const RawSymbolId count = symbolFactory.getSymbolCount();
+    if (!delta && !compact) {
+      m_symbolIds.resize(count);
+      std::iota(m_symbolIds.begin(), m_symbolIds.end(), BadRawSymbolId);
+      m_symbols = m_symbolIds;
+      return;
+    }
+
+    std::vector<SymbolId> used;
+    for (sections_t::const_reference section : sections) {
+      for (const BaseClass *obj : *section.second) obj->collectSymbols(used);
+    }
+
+    if (delta) {
+      const std::vector<RawSymbolId> &baseline = serializer->m_baselineSymbolIds;
+      if (baseline.empty()) {
+        m_symbolIds.resize(serializer->m_baselineSymbolCount);
+        std::iota(m_symbolIds.begin(), m_symbolIds.end(), BadRawSymbolId);
+      } else {
+        m_symbolIds = baseline;
+      }
+      m_symbolIds.resize(count, BadRawSymbolId);
+      for (SymbolId id : used) {
+        const RawSymbolId rid = (RawSymbolId)id;
+        if (m_symbolIds[rid] != BadRawSymbolId) continue;
+        m_symbolIds[rid] = serializer->m_baselineSymbolCount + static_cast<RawSymbolId>(m_symbols.size());
+        m_symbols.emplace_back(rid);
+      }
+      return;
+    }
+
+    // Files start with the bad symbol.
+    std::vector<bool> kept(count, false);
+    for (SymbolId id : used) kept[(RawSymbolId)id] = true;
+    m_symbols.emplace_back(BadRawSymbolId);
+    for (RawSymbolId rid = BadRawSymbolId + 1; rid < count; ++rid) {
+      if (kept[rid]) m_symbols.emplace_back(rid);
+    }
+    std::sort(m_symbols.begin() + 1, m_symbols.end(), [&symbolFactory](RawSymbolId lhs, RawSymbolId rhs) {
+      return symbolFactory.getOwnSymbol(lhs) < symbolFactory.getOwnSymbol(rhs);
+    });
+    m_symbolIds.assign(count, BadRawSymbolId);
+    for (RawSymbolId index = 0, n = static_cast<RawSymbolId>(m_symbols.size()); index < n; ++index) {
+      m_symbolIds[m_symbols[index]] = index;
+    }
+  }
+
+  // Saves the symbols numbered by mapSymbols(), patches only hold the ones
+  // their snapshot doesn't have.
+  void saveSymbols(Serializer *const serializer) {
+    const SymbolFactory &symbolFactory = serializer->m_symbolFactory;
+    ::capnp::MallocMessageBuilder message;
+    UhdmRoot::Builder cap_root = message.initRoot<UhdmRoot>();
+    cap_root.setVersion(kVersion);
+    cap_root.setObjectId(serializer->m_objId);
+
+    ::capnp::List<::capnp::Text>::Builder symbols = cap_root.initSymbols(static_cast<uint32_t>(m_symbols.size()));
     uint32_t index = 0;
-    for (const BaseClass* obj : factory->m_objects)
-      operator()(any_cast<T>(obj), serializer, idMap, builder[index++]);
+    for (RawSymbolId id : m_symbols) {
+      const std::string_view symbol = symbolFactory.getOwnSymbol(id);
+      symbols.set(index, ::capnp::Text::Reader(symbol.data(), symbol.size()));
+      index++;
+    }
+    writeSection(kSymbolsSection, index, message);
+  }
+
+  // Writes the kPatchSection. It is raw data of any size, so it goes last to
+  // keep the other sections word aligned.
+  void savePatch(Serializer *const serializer) {
+    std::vector<uint32_t> data;
+    const PatchHeader header{serializer->m_baselineSymbolCount, static_cast<uint32_t>(m_changes.size())};
+    auto append = [&data](const void *bytes, size_t size) {
+      const uint32_t *const words = static_cast<const uint32_t*>(bytes);
+      data.insert(data.end(), words, words + size / sizeof(uint32_t));
+    };
+    append(&header, sizeof(header));
+    for (const Change &change : m_changes) {
+      append(&change.entry, sizeof(change.entry));
+      append(change.erased.data(), change.erased.size() * sizeof(uint32_t));
+      append(change.written.data(), change.written.size() * sizeof(uint32_t));
+    }
+    writeSection(kPatchSection, header.entryCount, data.data(), data.size() * sizeof(uint32_t));
   }
+
+  // Writes the file header and leaves room for the table of contents.
+  void begin(uint32_t magic, uint32_t sectionCount) {
+    const FileHeader header{magic, kVersion, static_cast<uint32_t>(m_encoding), sectionCount};
+    writeBytes(m_fileid, &header, sizeof(header));
+    m_sections.reserve(sectionCount);
+    const std::vector<SectionEntry> placeholder(sectionCount, SectionEntry{});
+    writeBytes(m_fileid, placeholder.data(), placeholder.size() * sizeof(SectionEntry));
+    m_offset = sizeof(FileHeader) + placeholder.size() * sizeof(SectionEntry);
+  }
+
+  // Fills in the table of contents, now that every section is written.
+  void end() {
+    if (lseek(m_fileid, sizeof(FileHeader), SEEK_SET) < 0) return;
+    writeBytes(m_fileid, m_sections.data(), m_sections.size() * sizeof(SectionEntry));
+  }
+
+  // Cuts the flat message in blocks compressed independently, see
+  // BlockHeader.
+  static std::vector<uint8_t> compressBlocks(kj::ArrayPtr<const kj::byte> bytes) {
+    const BlockHeader header{bytes.size(), kCompressedBlockSize,
+                             static_cast<uint32_t>((bytes.size() + kCompressedBlockSize - 1) / kCompressedBlockSize)};
+    const size_t blocksOffset = sizeof(header) + header.blockCount * sizeof(uint32_t);
+    size_t capacity = blocksOffset;
+    for (size_t offset = 0; offset < bytes.size(); offset += header.blockSize) {
+      capacity += BlockCodec::getMaxCompressedSize(std::min<size_t>(header.blockSize, bytes.size() - offset));
+    }
+
+    std::vector<uint8_t> data(capacity);
+    std::vector<uint32_t> sizes;
+    sizes.reserve(header.blockCount);
+    size_t end = blocksOffset;
+    for (size_t offset = 0; offset < bytes.size(); offset += header.blockSize) {
+      const size_t size = std::min<size_t>(header.blockSize, bytes.size() - offset);
+      sizes.emplace_back(static_cast<uint32_t>(BlockCodec::compress(bytes.begin() + offset, size, data.data() + end)));
+      end += sizes.back();
+    }
+    std::memcpy(data.data(), &header, sizeof(header));
+    if (!sizes.empty()) std::memcpy(data.data() + sizeof(header), sizes.data(), sizes.size() * sizeof(uint32_t));
+    data.resize(end);
+    return data;
+  }
+
+  // Appends the message to the file, safe to call from several threads.
+  void writeSection(uint32_t type, uint32_t count, ::capnp::MessageBuilder &message) {
+    if (m_encoding == Encoding::Compressed) {
+      const kj::Array<::capnp::word> words = ::capnp::messageToFlatArray(message);
+      const std::vector<uint8_t> data = compressBlocks(words.asBytes());
+      writeSection(type, count, data.data(), data.size());
+      return;
+    }
+
+    kj::VectorOutputStream out;
+    if (m_encoding == Encoding::Flat) {
+      // Unpacked, word aligned layout that restore can read in place.
+      ::capnp::writeMessage(out, message);
+    } else {
+      ::capnp::writePackedMessage(out, message);
+    }
+
+    const kj::ArrayPtr<kj::byte> bytes = out.getArray();
+    writeSection(type, count, bytes.begin(), bytes.size());
+  }
+
+  void writeSection(uint32_t type, uint32_t count, const void *data, size_t size) {
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    m_sections.emplace_back(SectionEntry{type, count, m_offset, size});
+    writeBytes(m_fileid, data, size);
+    m_offset += size;
+  }
+
+  int32_t m_fileid = -1;
+  Encoding m_encoding = Encoding::Packed;
+  std::mutex m_fileMutex;
+  uint64_t m_offset = 0;
+  std::vector<SectionEntry> m_sections;
+  std::vector<Change> m_changes;
+  // Id in the file of the symbols by their raw id, BadRawSymbolId for the
+  // ones left out, and the symbols written, in the order of their ids.
+  std::vector<RawSymbolId> m_symbolIds;
+  std::vector<RawSymbolId> m_symbols;
+  const Serializer *m_serializer = nullptr;
+  // Objects of the factories by type.
+  std::vector<const Factory::objects_t*> m_objects;
 };
 
 void Serializer::save(const std::filesystem::path& filepath) {
@@ -86,34 +363,84 @@ void Serializer::save(const std::filesystem::path& filepath) {
 }
 
 void Serializer::save(const std::string& filepath) {
-  if (m_enableGC) collectGarbage();
+  save(filepath, SaveOptions());
+}
 
-  uint32_t index = 0;
-  const std::string file = filepath;
-  const int32_t fileid = open(file.c_str(), O_CREAT | O_WRONLY | O_BINARY, S_IRWXU);
+void Serializer::save(const std::filesystem::path& filepath, const SaveOptions& options) {
+  save(filepath.string(), options);
+}
 
-  ::capnp::MallocMessageBuilder message;
-  UhdmRoot::Builder cap_root = message.initRoot<UhdmRoot>();
-  cap_root.setVersion(kVersion);
-  cap_root.setObjectId(m_objId);
+void Serializer::save(const std::string& filepath, const SaveOptions& options) {
+  materializeAll();
+  // Collecting garbage walks the whole design, a delta leaves it to full
+  // saves.
+  const bool delta = options.delta && m_hasBaseline;
+  uint32_t threadCount = options.threads;
+  if (threadCount == 0) threadCount = std::max(1U, std::thread::hardware_concurrency());
+  if (m_enableGC && !delta) collectGarbage(threadCount);
+  for (factories_t::const_reference entry : m_factories) {
+    entry.second->compact();
+  }
 
-  const IdMap idMap = getAllObjects();
   SaveAdapter adapter;
-<CAPNP_SAVE>
+  adapter.indexObjects(this);
+  SaveAdapter::sections_t sections;
+  if (delta) {
+    adapter.collectChanges(this);
+    for (const SaveAdapter::Change &change : adapter.m_changes) {
+      if (!change.objects.empty()) sections.emplace_back(static_cast<UhdmType>(change.entry.type), &change.objects);
+    }
+  } else {
+    for (factories_t::const_reference entry : m_factories) {
+      if (!entry.second->m_objects.empty()) sections.emplace_back(entry.first, &entry.second->m_objects);
+    }
+  }
+
+  for (SaveAdapter::sections_t::const_reference section : sections) {
+    dispatch(section.first, [&](auto *tag, auto init) {
+      using T = std::remove_pointer_t<decltype(tag)>;
+      for (const BaseClass *obj : *section.second) adapter.prepare(any_cast<T>(obj));
+    });
+  }
+  // Once every symbol is made.
+  const bool compact = options.compactSymbols && !delta;
+  adapter.mapSymbols(this, sections, delta, compact);
+
+  const std::string file = filepath;
+  adapter.m_fileid = open(file.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, S_IRWXU);
+  adapter.m_encoding = options.encoding;
+  adapter.begin(delta ? kPatchMagic : kMagic, static_cast<uint32_t>(sections.size() + (delta ? 2 : 1)));
+
+  if ((threadCount == 1) || (sections.size() < 2)) {
+    for (SaveAdapter::sections_t::const_reference section : sections) {
+      adapter.saveSection(this, section.first, *section.second);
+    }
+  } else {
+    // Each section is written out as soon as it is encoded, in no
+    // particular order.
+    ThreadPool pool(std::min<uint32_t>(threadCount, static_cast<uint32_t>(sections.size())));
+    for (SaveAdapter::sections_t::const_reference section : sections) {
+      pool.submit([&, section]() { adapter.saveSection(this, section.first, *section.second); });
+    }
+    pool.wait();
+  }
 
-  // Save the symbols after all save function have been invoked, some symbols are made doing so (VpiFullName)
-  // This is not ideal.
   // Ideally, the save should not include the hierarchical nets that can be recreated on the fly.
   // Something broke this mechanism that saved a lot of memory/disk space.
   // Until that is repaired we go for the more disk-hungry and memory hungry method which gives correct results.
-  ::capnp::List<::capnp::Text>::Builder symbols = cap_root.initSymbols(m_symbolFactory.m_id2SymbolMap.size());
-  index = 0;
-  for (const auto& symbol : m_symbolFactory.m_id2SymbolMap) {
-    symbols.set(index, symbol.c_str());
-    index++;
-  }
+  adapter.saveSymbols(this);
+  if (delta) adapter.savePatch(this);
+  adapter.end();
+  close(adapter.m_fileid);
 
-  writePackedMessageToFd(fileid, message);
-  close(fileid);
+  // Deltas are all saved against the same snapshot, with its numbering of
+  // the symbols.
+  if (!delta) {
+    resetBaseline();
+    if (compact) {
+      m_baselineSymbolIds = std::move(adapter.m_symbolIds);
+      m_baselineSymbolCount = static_cast<uint32_t>(adapter.m_symbols.size());
+    }
+  }
 }
 }  // namespace uhdm
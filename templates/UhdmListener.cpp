@@ -22,6 +22,7 @@
  *
  * Created on March 11, 2022, 00:00 AM
  */
+#include <uhdm/ThreadPool.h>
 #include <uhdm/UhdmListener.h>
 #include <uhdm/uhdm.h>
 
@@ -40,21 +41,53 @@ ScopedVpiHandle::~ScopedVpiHandle() {
 
 bool UhdmListener::didVisitAll(const Serializer& serializer) const {
   const Serializer::IdMap idMap = serializer.getAllObjects();
-
-  any_set_t allObjects;
-  std::transform(
+  if (m_visited.size() < idMap.size()) return false;
+  return std::all_of(
       idMap.cbegin(), idMap.cend(),
-      std::inserter(allObjects, allObjects.begin()),
-      [](std::map<const BaseClass*, uint32_t>::const_reference entry) {
-        return entry.first;
+      [this](std::map<const BaseClass*, uint32_t>::const_reference entry) {
+        return m_visited.contains(entry.first);
       });
+}
+
+void UhdmListener::listenTopModules(const Design* design,
+                                    uint32_t threadCount /* = 0 */) {
+  const ModuleCollection* const topModules = design->getTopModules();
+  if ((topModules == nullptr) || m_abortRequested) return;
 
-  any_set_t diffObjects;
-  std::set_difference(allObjects.begin(), allObjects.end(), m_visited.begin(),
-                      m_visited.end(),
-                      std::inserter(diffObjects, diffObjects.begin()));
+  std::vector<std::unique_ptr<UhdmListener>> workers;
+  workers.reserve(topModules->size());
+  for (size_t i = 0, n = topModules->size(); i < n; ++i) {
+    std::unique_ptr<UhdmListener> worker = makeWorker();
+    if (!worker) break;
+    workers.emplace_back(std::move(worker));
+  }
+  if (workers.size() != topModules->size()) {
+    m_callstack.emplace_back(design);
+    for (const Module* module : *topModules) {
+      listenAny(module, vpiTopModules);
+    }
+    m_callstack.pop_back();
+    return;
+  }
 
-  return diffObjects.empty();
+  // A lazy restore materializes objects on first access, which isn't safe
+  // from several threads.
+  if (Serializer* const serializer = design->getSerializer()) {
+    serializer->materializeAll();
+  }
+
+  ThreadPool::parallelFor(threadCount, workers.size(), [&](size_t i) {
+    UhdmListener* const worker = workers[i].get();
+    worker->m_callstack.emplace_back(design);
+    worker->listenAny(topModules->at(i), vpiTopModules);
+    worker->m_callstack.pop_back();
+  });
+
+  for (const std::unique_ptr<UhdmListener>& worker : workers) {
+    for (const Any* any : worker->m_visited) m_visited.emplace(any);
+    m_abortRequested = m_abortRequested || worker->m_abortRequested;
+    mergeWorker(worker.get());
+  }
 }
 
 void UhdmListener::listenAny_(const Any* object) {
@@ -68,7 +101,75 @@ void UhdmListener::listenAny_(const Any* object) {
 
 <UHDM_PRIVATE_LISTEN_IMPLEMENTATIONS>
 <UHDM_PUBLIC_LISTEN_IMPLEMENTATIONS>
+<UHDM_STEP_IMPLEMENTATIONS>
+bool UhdmListener::enterFrame_(const Any* object, uint32_t vpiRelation) {
+  switch (object->getUhdmType()) {
+<UHDM_ENTER_FRAME_IMPLEMENTATION>
+    default: break;
+  }
+  return false;
+}
+
+void UhdmListener::leaveFrame_(const Any* object, uint32_t vpiRelation) {
+  switch (object->getUhdmType()) {
+<UHDM_LEAVE_FRAME_IMPLEMENTATION>
+    default: break;
+  }
+}
+
+bool UhdmListener::stepFrame_(Frame& frame, const Any** child,
+                              uint32_t* vpiRelation) {
+  switch (frame.object->getUhdmType()) {
+<UHDM_STEP_FRAME_IMPLEMENTATION>
+    default: break;
+  }
+  return false;
+}
+
+// Same as listenAny followed by listen<Type>: objects already visited, or of
+// no known type, are entered and left without a frame.
+void UhdmListener::openFrame(frame_stack_t& frames, const Any* object,
+                             uint32_t vpiRelation) {
+  if (m_abortRequested) return;
+  enterAny(object, vpiRelation);
+  if (enterFrame_(object, vpiRelation)) {
+    if (m_visited.emplace(object).second) {
+      m_callstack.emplace_back(object);
+      frames.emplace_back(Frame{object, vpiRelation});
+      return;
+    }
+    leaveFrame_(object, vpiRelation);
+  }
+  leaveAny(object, vpiRelation);
+}
+
+void UhdmListener::listenAnyIteratively(const Any* object,
+                                        uint32_t vpiRelation) {
+  // Local to the call: callbacks listening on their own get a stack of
+  // their own, and can't move the frame being stepped.
+  frame_stack_t frames;
+  openFrame(frames, object, vpiRelation);
+  while (!frames.empty()) {
+    const Any* child = nullptr;
+    uint32_t childRelation = 0;
+    if (stepFrame_(frames.back(), &child, &childRelation)) {
+      openFrame(frames, child, childRelation);
+      continue;
+    }
+
+    const Frame frame = frames.back();
+    frames.pop_back();
+    m_callstack.pop_back();
+    leaveFrame_(frame.object, frame.vpiRelation);
+    leaveAny(frame.object, frame.vpiRelation);
+  }
+}
+
 void UhdmListener::listenAny(const Any* object, uint32_t vpiRelation) {
+  if (m_iterative) {
+    listenAnyIteratively(object, vpiRelation);
+    return;
+  }
   if (m_abortRequested) return;
   enterAny(object, vpiRelation);
   switch (object->getUhdmType()) {
@@ -28,11 +28,13 @@
 #define UHDM_UHDMLISTENER_H
 
 #include <uhdm/BaseClass.h>
+#include <uhdm/VisitedSet.h>
 #include <uhdm/containers.h>
 #include <uhdm/sv_vpi_user.h>
 #include <uhdm/uhdm_types.h>
 
 #include <algorithm>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -53,7 +55,7 @@ class ScopedVpiHandle final {
 
 class UhdmListener {
 protected:
-  using any_set_t = std::set<const Any *>;
+  using any_set_t = VisitedSet;
   using any_stack_t = std::vector<const Any *>;
 
 public:
@@ -81,8 +83,27 @@ public:
 
   void requestAbort() { m_abortRequested = true; }
 
+  // Walks with an explicit stack of objects in place of a C++ call per object
+  // and relation, so the depth of the model doesn't bound the thread's stack.
+  // Callbacks are invoked in the same order either way. Applies to listenAny
+  // and all it reaches from there.
+  void setIterative(bool iterative) { m_iterative = iterative; }
+  bool isIterative() const { return m_iterative; }
+
   bool didVisitAll(const Serializer &serializer) const;
 
+  // Walks the top modules of design, as listenDesign does through
+  // vpiTopModules, on up to threadCount threads (0 for all cores). Each top
+  // module is walked by its own listener from makeWorker(), with design on
+  // its callstack, so objects reachable from several top modules are seen by
+  // each of them. Once all are done, the workers are handed to mergeWorker()
+  // in the order of the top modules, and their visited objects added to this
+  // listener's. Without workers, this listener walks them on the calling
+  // thread. A lazily restored design is materialized beforehand, see
+  // Serializer::materializeAll(). The work is only split per top module: a
+  // design with a single top module is walked on a single thread.
+  void listenTopModules(const Design *design, uint32_t threadCount = 0);
+
   void listenAny(const Any* object, uint32_t vpiRelation = 0);
 <UHDM_PUBLIC_LISTEN_DECLARATIONS>
 
@@ -91,7 +112,30 @@ public:
 
 <UHDM_ENTER_LEAVE_DECLARATIONS>
 <UHDM_ENTER_LEAVE_COLLECTION_DECLARATIONS>
+protected:
+  // Hooks of listenTopModules. Workers only read the model, and must not
+  // share mutable state with this listener or with each other.
+  virtual std::unique_ptr<UhdmListener> makeWorker() const { return nullptr; }
+  virtual void mergeWorker(UhdmListener *worker) {}
+
 private:
+  // Object being walked by listenAnyIteratively, and where it is at: step
+  // counts the relations of its type, index the members of collection.
+  struct Frame final {
+    const Any *object = nullptr;
+    uint32_t vpiRelation = 0;
+    uint32_t step = 0;
+    size_t index = 0;
+    const void *collection = nullptr;
+  };
+  using frame_stack_t = std::vector<Frame>;
+
+  void listenAnyIteratively(const Any *object, uint32_t vpiRelation);
+  void openFrame(frame_stack_t &frames, const Any *object, uint32_t vpiRelation);
+  bool enterFrame_(const Any *object, uint32_t vpiRelation);
+  void leaveFrame_(const Any *object, uint32_t vpiRelation);
+  bool stepFrame_(Frame &frame, const Any **child, uint32_t *vpiRelation);
+
   void listenAny_(const Any* object);
 <UHDM_PRIVATE_LISTEN_DECLARATIONS>
 
@@ -99,6 +143,7 @@ protected:
   any_set_t m_visited;
   any_stack_t m_callstack;
   bool m_abortRequested = false;
+  bool m_iterative = false;
 };
 }  // namespace uhdm
 
@@ -38,6 +38,73 @@ void VpiListener::listenBaseClass_(vpiHandle handle) {
 
 <VPI_PRIVATE_LISTEN_IMPLEMENTATIONS>
 <VPI_PUBLIC_LISTEN_IMPLEMENTATIONS>
+<VPI_STEP_IMPLEMENTATIONS>
+bool VpiListener::enterFrame_(vpiHandle handle) {
+  const Any* const object = (const Any*)((const uhdm_handle*)handle)->object;
+  switch (((const uhdm_handle*)handle)->type) {
+<VPI_ENTER_FRAME_IMPLEMENTATION>
+    default : break;
+  }
+  return false;
+}
+
+void VpiListener::leaveFrame_(vpiHandle handle) {
+  const Any* const object = (const Any*)((const uhdm_handle*)handle)->object;
+  switch (((const uhdm_handle*)handle)->type) {
+<VPI_LEAVE_FRAME_IMPLEMENTATION>
+    default : break;
+  }
+}
+
+bool VpiListener::stepFrame_(Frame& frame, vpiHandle* child) {
+  switch (((const uhdm_handle*)frame.handle)->type) {
+<VPI_STEP_FRAME_IMPLEMENTATION>
+    default : break;
+  }
+  return false;
+}
+
+// Same as listenAny followed by listen<Type>: objects already visited, or of
+// no known type, are entered and left without a frame.
+void VpiListener::openFrame(frame_stack_t& frames, vpiHandle handle,
+                            bool owned) {
+  if (!m_abortRequested) {
+    const Any* const object = (const Any*)((const uhdm_handle*)handle)->object;
+    enterAny(object, handle);
+    if (enterFrame_(handle)) {
+      if (m_visited.insert(object).second) {
+        m_callstack.emplace_back(object);
+        frames.emplace_back(Frame{handle, nullptr, 0, owned});
+        return;
+      }
+      leaveFrame_(handle);
+    }
+    leaveAny(object, handle);
+  }
+  if (owned) vpi_free_object(handle);
+}
+
+void VpiListener::listenAnyIteratively(vpiHandle handle) {
+  // Local to the call: callbacks listening on their own get a stack of
+  // their own, and can't move the frame being stepped.
+  frame_stack_t frames;
+  openFrame(frames, handle, false);
+  while (!frames.empty()) {
+    vpiHandle child = nullptr;
+    if (stepFrame_(frames.back(), &child)) {
+      openFrame(frames, child, true);
+      continue;
+    }
+
+    const Frame frame = frames.back();
+    frames.pop_back();
+    m_callstack.pop_back();
+    leaveFrame_(frame.handle);
+    leaveAny((const Any*)((const uhdm_handle*)frame.handle)->object,
+             frame.handle);
+    if (frame.owned) vpi_free_object(frame.handle);
+  }
+}
 
 bool VpiListener::inCallstackOfType(UhdmType type) {
   for (any_stack_t::reverse_iterator itr = m_callstack.rbegin(); itr != m_callstack.rend(); ++itr) {
@@ -49,6 +116,10 @@ bool VpiListener::inCallstackOfType(UhdmType type) {
 }
 
 void VpiListener::listenAny(vpiHandle handle) {
+  if (m_iterative) {
+    listenAnyIteratively(handle);
+    return;
+  }
   if (m_abortRequested) return;
   const Any* object = (const Any*)((const uhdm_handle*)handle)->object;
   enterAny(object, handle);
@@ -27,6 +27,7 @@
 #ifndef UHDM_VPILISTENER_H
 #define UHDM_VPILISTENER_H
 
+#include <uhdm/VisitedSet.h>
 #include <uhdm/containers.h>
 #include <uhdm/uhdm_types.h>
 #include <uhdm/vpi_user.h>
@@ -37,7 +38,7 @@
 namespace uhdm {
 class VpiListener {
 protected:
-  using visited_t = std::set<const Any*>;
+  using visited_t = VisitedSet;
   using any_stack_t = std::vector<const Any *>;
 
 public:
@@ -61,14 +62,36 @@ public:
 
   void requestAbort() { m_abortRequested = true; }
 
+  // Walks with an explicit stack of handles in place of a C++ call per object
+  // and relation, see UhdmListener::setIterative.
+  void setIterative(bool iterative) { m_iterative = iterative; }
+  bool isIterative() const { return m_iterative; }
+
 protected:
   visited_t m_visited;
   any_stack_t m_callstack;
   bool m_abortRequested = false;
   bool uhdmAllIterator = false;
   Design* m_currentDesign = nullptr;
+  bool m_iterative = false;
 
 private:
+  // Handle being walked by listenAnyIteratively, and where it is at: step
+  // counts the relations of its type, iterator scans the current one.
+  struct Frame final {
+    vpiHandle handle = nullptr;
+    vpiHandle iterator = nullptr;
+    uint32_t step = 0;
+    bool owned = false;  // Released once left.
+  };
+  using frame_stack_t = std::vector<Frame>;
+
+  void listenAnyIteratively(vpiHandle handle);
+  void openFrame(frame_stack_t& frames, vpiHandle handle, bool owned);
+  bool enterFrame_(vpiHandle handle);
+  void leaveFrame_(vpiHandle handle);
+  bool stepFrame_(Frame& frame, vpiHandle* child);
+
   void listenBaseClass_(vpiHandle handle);
 <VPI_PRIVATE_LISTEN_DECLARATIONS>
 };
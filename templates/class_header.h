@@ -37,6 +37,7 @@
 namespace uhdm {
 class <CLASSNAME><FINAL_CLASS> : public <EXTENDS> {
   UHDM_IMPLEMENT_RTTI(<CLASSNAME>, <EXTENDS>)
+  friend Serializer;
 
 public:
   static constexpr UhdmType kUhdmType = UhdmType::<CLASSNAME>;
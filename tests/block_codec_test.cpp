@@ -0,0 +1,71 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ Copyright 2022 The UHDM Team.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "uhdm/BlockCodec.h"
+
+namespace uhdm {
+namespace {
+std::vector<uint8_t> compress(const std::vector<uint8_t>& data) {
+  std::vector<uint8_t> compressed(BlockCodec::getMaxCompressedSize(data.size()));
+  compressed.resize(
+      BlockCodec::compress(data.data(), data.size(), compressed.data()));
+  return compressed;
+}
+
+TEST(BlockCodecTest, RoundTrip) {
+  std::vector<std::vector<uint8_t>> inputs(4);
+  // Mostly zeros, like unpacked Cap'n Proto words.
+  inputs[1].resize(100000);
+  for (size_t i = 0; i < inputs[1].size(); i += 24) inputs[1][i] = i % 7;
+  // Long runs and long literals, past the extended length encoding.
+  inputs[2].assign(1000, 'a');
+  uint32_t seed = 1;
+  for (int32_t i = 0; i < 1000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    inputs[2].emplace_back(seed >> 16);
+  }
+  inputs[3] = {1, 2, 3};
+
+  for (const std::vector<uint8_t>& input : inputs) {
+    const std::vector<uint8_t> compressed = compress(input);
+    std::vector<uint8_t> output(input.size());
+    ASSERT_TRUE(BlockCodec::decompress(compressed.data(), compressed.size(),
+                                       output.data(), output.size()));
+    EXPECT_EQ(input, output);
+  }
+  EXPECT_LT(compress(inputs[1]).size(), inputs[1].size() / 20);
+}
+
+TEST(BlockCodecTest, RejectsMalformedBlocks) {
+  std::vector<uint8_t> input(1000, 0);
+  const std::vector<uint8_t> compressed = compress(input);
+  std::vector<uint8_t> output(input.size() + 1);
+
+  // Wrong size, truncated block, offset before the start of the block.
+  EXPECT_FALSE(BlockCodec::decompress(compressed.data(), compressed.size(),
+                                      output.data(), output.size()));
+  EXPECT_FALSE(BlockCodec::decompress(compressed.data(), compressed.size() / 2,
+                                      output.data(), input.size()));
+  const std::vector<uint8_t> bad = {0x10, 'a', 0x02, 0x00};
+  EXPECT_FALSE(
+      BlockCodec::decompress(bad.data(), bad.size(), output.data(), 5));
+}
+}  // namespace
+}  // namespace uhdm
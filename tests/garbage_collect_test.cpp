@@ -1,5 +1,6 @@
 // -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
 
+#include <algorithm>
 #include <iostream>
 
 #include "gtest/gtest.h"
@@ -65,3 +66,127 @@ TEST(GarbageCollectTest, NoLeakExpectation) {
     vpi_release_handle(design);
   }
 }
+
+TEST(GarbageCollectTest, OwnedObjectsSurvive) {
+  for (uint32_t threadCount : {1, 4}) {
+    Serializer serializer;
+    Design* const d = serializer.make<Design>();
+    ModuleCollection* const modules = serializer.makeCollection<Module>();
+    d->setAllModules(modules);
+    for (int32_t i = 0; i < 100; ++i) {
+      Module* const m = serializer.make<Module>();
+      m->setParent(d);
+      modules->push_back(m);
+      for (int32_t j = 0; j < 10; ++j) {
+        serializer.make<Net>()->setParent(m);
+      }
+    }
+
+    // An orphan with a net, one of them also referred to by a live module.
+    Module* const orphan = serializer.make<Module>();
+    Net* const stray = serializer.make<Net>();
+    stray->setParent(orphan);
+    Module* const live = modules->front();
+    live->getNets()->push_back(stray);
+    serializer.make<Net>();
+
+    serializer.collectGarbage(threadCount);
+    std::map<std::string, uint32_t, std::less<>> stats =
+        serializer.getObjectStats();
+    EXPECT_EQ(stats["Design"], 1);
+    EXPECT_EQ(stats["Module"], 100);
+    EXPECT_EQ(stats["Net"], 1000);
+    EXPECT_EQ(live->getNets()->size(), 10);
+    for (const Net* n : *live->getNets()) EXPECT_EQ(n->getParent(), live);
+  }
+}
+
+TEST(GarbageCollectTest, UnifiesEqualTypespecs) {
+  Serializer serializer;
+  Design* const d = serializer.make<Design>();
+  ModuleCollection* const modules = serializer.makeCollection<Module>();
+  d->setAllModules(modules);
+  std::vector<LogicTypespec*> typespecs;
+  for (int32_t i = 0; i < 2; ++i) {
+    Module* const m = serializer.make<Module>();
+    m->setParent(d);
+    modules->push_back(m);
+    for (bool isSigned : {false, false, true}) {
+      LogicTypespec* const t = serializer.make<LogicTypespec>();
+      t->setSigned(isSigned);
+      t->setFile("top.sv");
+      // Ignored for primitive types.
+      t->setStartLine(static_cast<uint32_t>(typespecs.size()));
+      t->setParent(m);
+      typespecs.emplace_back(t);
+    }
+  }
+  // Refers to a duplicate, ends up referring to the first one.
+  RefTypespec* const rt = serializer.make<RefTypespec>();
+  rt->setParent(modules->back());
+  rt->setActual(typespecs[3]);
+  modules->back()->getInstanceItems(true)->push_back(rt);
+
+  serializer.collectGarbage();
+  EXPECT_EQ(serializer.getObjectStats()["LogicTypespec"], 2);
+  EXPECT_EQ(rt->getActual(), typespecs[0]);
+  EXPECT_EQ(modules->front()->getTypespecs()->size(), 2);
+  EXPECT_EQ(modules->back()->getTypespecs()->at(0), typespecs[0]);
+  EXPECT_EQ(modules->back()->getTypespecs()->at(1), typespecs[2]);
+}
+
+TEST(GarbageCollectTest, CollectsChangedGarbage) {
+  Serializer serializer;
+  Design* const d = serializer.make<Design>();
+  ModuleCollection* const modules = serializer.makeCollection<Module>();
+  d->setAllModules(modules);
+  for (int32_t i = 0; i < 10; ++i) {
+    Module* const m = serializer.make<Module>();
+    m->setParent(d);
+    modules->push_back(m);
+    for (int32_t j = 0; j < 10; ++j) {
+      serializer.make<Net>()->setParent(m);
+    }
+  }
+  serializer.make<Net>();
+  serializer.collectChangedGarbage();
+  EXPECT_EQ(serializer.getObjectStats()["Net"], 100);
+
+  // Nothing changed.
+  serializer.collectChangedGarbage();
+  EXPECT_EQ(serializer.getObjectStats()["Net"], 100);
+
+  // A module drops its nets, another one gets a new net, and an orphan.
+  Module* const dropping = modules->at(3);
+  Net* const dropped = dropping->getNets()->front();
+  dropping->setNets(nullptr);
+  dropping->setInstanceItems(nullptr);
+  serializer.make<Net>()->setParent(modules->at(5));
+  serializer.make<Net>();
+  // Refers to a dropped net, that reference goes too.
+  RefObj* const r = serializer.make<RefObj>();
+  r->setParent(modules->at(7));
+  r->setActual(dropped);
+  modules->at(7)->getInstanceItems(true)->push_back(r);
+
+  serializer.collectChangedGarbage();
+  EXPECT_EQ(serializer.getObjectStats()["Net"], 91);
+  EXPECT_EQ(serializer.getObjectStats()["RefObj"], 1);
+  EXPECT_EQ(r->getActual(), nullptr);
+  EXPECT_EQ(modules->at(5)->getNets()->size(), 11);
+
+  // A net dropped by editing the collections of its module in place.
+  Module* const editing = modules->at(8);
+  Net* const popped = editing->getNets()->back();
+  editing->getNets()->pop_back();
+  AnyCollection* const items = editing->getInstanceItems();
+  items->erase(std::find(items->begin(), items->end(), popped));
+  editing->touch();
+  serializer.collectChangedGarbage();
+  EXPECT_EQ(serializer.getObjectStats()["Net"], 90);
+
+  // A full collection agrees.
+  serializer.collectGarbage();
+  EXPECT_EQ(serializer.getObjectStats()["Net"], 90);
+  EXPECT_EQ(serializer.getObjectStats()["RefObj"], 1);
+}
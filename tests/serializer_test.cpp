@@ -0,0 +1,659 @@
+// -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "gtest/gtest.h"
+#include "test_util.h"
+#include "uhdm/uhdm.h"
+#include "uhdm/vpi_visitor.h"
+
+using namespace uhdm;
+
+static std::vector<vpiHandle> buildDesign(Serializer* s) {
+  std::vector<vpiHandle> designs;
+  Design* d = s->make<Design>();
+  d->setName("design1");
+
+  Module* m1 = s->make<Module>();
+  m1->setTopModule(true);
+  m1->setDefName("M1");
+  m1->setName("top");
+  m1->setParent(d);
+  m1->setFile("top.sv");
+  m1->setStartLine(1);
+  d->getTopModules(true)->emplace_back(m1);
+
+  Module* m2 = s->make<Module>();
+  m2->setDefName("M2");
+  m2->setName("u1");
+  m2->setParent(m1);
+  m2->setFile("m2.sv");
+  m2->setStartLine(10);
+
+  Port* p = s->make<Port>();
+  p->setName("i1");
+  p->setDirection(vpiInput);
+  p->setParent(m2);
+
+  Net* n = s->make<Net>();
+  n->setName("w");
+  n->setParent(m2);
+
+  RefObj* r = s->make<RefObj>();
+  r->setName("w");
+  r->setActual(n);
+  r->setParent(p);
+  p->setHighConn(r);
+
+  Function* f = s->make<Function>();
+  f->setName("MyFunc");
+  f->setSize(10);
+  f->setParent(m1);
+
+  designs.emplace_back(s->makeUhdmHandle(UhdmType::Design, d));
+  return designs;
+}
+
+TEST(Serializer, FlatEncodingRoundTrip) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const std::string orig = designs_to_string(designs);
+
+  const std::string filename = testing::TempDir() + "/serializer-flat.uhdm";
+  Serializer::SaveOptions saveOptions;
+  saveOptions.encoding = Serializer::Encoding::Flat;
+  serializer.save(filename, saveOptions);
+
+  // Restore reads the encoding from the file.
+  const std::vector<vpiHandle> restored = serializer.restore(filename);
+  ASSERT_EQ(restored.size(), 1);
+  EXPECT_EQ(orig, designs_to_string(restored));
+}
+
+TEST(Serializer, FlatRestoreOfMissingFile) {
+  Serializer serializer;
+  EXPECT_TRUE(
+      serializer.restore(testing::TempDir() + "/does-not-exist.uhdm").empty());
+}
+
+TEST(Serializer, LazyRestore) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const std::string orig = designs_to_string(designs);
+
+  const std::string filename = testing::TempDir() + "/serializer-lazy.uhdm";
+  serializer.save(filename);
+
+  Serializer::RestoreOptions options;
+  options.lazy = true;
+  const std::vector<vpiHandle> restored = serializer.restore(filename, options);
+  ASSERT_EQ(restored.size(), 1);
+  EXPECT_EQ(orig, designs_to_string(restored));
+}
+
+TEST(Serializer, LazyRestoreThenSave) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const std::string orig = designs_to_string(designs);
+
+  const std::string filename = testing::TempDir() + "/serializer-lazy.uhdm";
+  serializer.save(filename);
+
+  Serializer::RestoreOptions options;
+  options.lazy = true;
+  std::vector<vpiHandle> restored = serializer.restore(filename, options);
+  ASSERT_EQ(restored.size(), 1);
+
+  // Touch part of the design only, the save completes the rest.
+  const Design* const d =
+      (const Design*)((const uhdm_handle*)restored.front())->object;
+  ASSERT_NE(d->getTopModules(), nullptr);
+  ASSERT_EQ(d->getTopModules()->size(), 1);
+  EXPECT_EQ(d->getTopModules()->front()->getName(), "top");
+
+  const std::string resaved = testing::TempDir() + "/serializer-lazy2.uhdm";
+  serializer.save(resaved);
+  restored = serializer.restore(resaved);
+  EXPECT_EQ(orig, designs_to_string(restored));
+}
+
+TEST(Serializer, ParallelRestore) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  // Enough objects for the fill to be split in several ranges.
+  const Design* const d =
+      (const Design*)((const uhdm_handle*)designs.front())->object;
+  Module* const top = d->getTopModules()->front();
+  for (int32_t i = 0; i < 10000; ++i) {
+    Net* n = serializer.make<Net>();
+    n->setName("n" + std::to_string(i));
+    n->setParent(top);
+  }
+  const std::string orig = designs_to_string(designs);
+
+  const std::string filename =
+      testing::TempDir() + "/serializer-parallel.uhdm";
+  for (Serializer::Encoding encoding :
+       {Serializer::Encoding::Packed, Serializer::Encoding::Flat,
+        Serializer::Encoding::Compressed}) {
+    Serializer::SaveOptions saveOptions;
+    saveOptions.encoding = encoding;
+    serializer.save(filename, saveOptions);
+
+    Serializer::RestoreOptions options;
+    options.threads = 4;
+    const std::vector<vpiHandle> restored =
+        serializer.restore(filename, options);
+    ASSERT_EQ(restored.size(), 1);
+    EXPECT_EQ(orig, designs_to_string(restored));
+    EXPECT_EQ(serializer.getFactory<Net>()->getObjects().size(), 10001);
+  }
+}
+
+TEST(Serializer, ParallelSave) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const std::string orig = designs_to_string(designs);
+
+  const std::string filename = testing::TempDir() + "/serializer-psave.uhdm";
+  for (Serializer::Encoding encoding :
+       {Serializer::Encoding::Packed, Serializer::Encoding::Flat,
+        Serializer::Encoding::Compressed}) {
+    Serializer::SaveOptions saveOptions;
+    saveOptions.encoding = encoding;
+    saveOptions.threads = 4;
+    serializer.save(filename, saveOptions);
+
+    const std::vector<vpiHandle> restored = serializer.restore(filename);
+    ASSERT_EQ(restored.size(), 1);
+    EXPECT_EQ(orig, designs_to_string(restored));
+  }
+}
+
+TEST(Serializer, CompressedEncoding) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const Design* const d =
+      (const Design*)((const uhdm_handle*)designs.front())->object;
+  Module* const top = d->getTopModules()->front();
+  for (int32_t i = 0; i < 1000; ++i) {
+    Net* n = serializer.make<Net>();
+    n->setName("n" + std::to_string(i));
+    n->setParent(top);
+  }
+  const std::string orig = designs_to_string(designs);
+
+  const std::string flat = testing::TempDir() + "/serializer-flat.uhdm";
+  Serializer::SaveOptions saveOptions;
+  saveOptions.encoding = Serializer::Encoding::Flat;
+  serializer.save(flat, saveOptions);
+
+  const std::string filename =
+      testing::TempDir() + "/serializer-compressed.uhdm";
+  saveOptions.encoding = Serializer::Encoding::Compressed;
+  serializer.save(filename, saveOptions);
+  EXPECT_LT(std::filesystem::file_size(filename),
+            std::filesystem::file_size(flat) / 2);
+
+  Serializer::FileInfo info;
+  ASSERT_TRUE(Serializer::readFileInfo(filename, &info));
+  EXPECT_EQ(info.encoding, Serializer::Encoding::Compressed);
+
+  // Lazy restores decompress sections on first access.
+  Serializer::RestoreOptions options;
+  options.lazy = true;
+  const std::vector<vpiHandle> restored = serializer.restore(filename, options);
+  ASSERT_EQ(restored.size(), 1);
+  EXPECT_EQ(orig, designs_to_string(restored));
+}
+
+TEST(Serializer, SlotsFollowFactoryOrder) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const Design* const d =
+      (const Design*)((const uhdm_handle*)designs.front())->object;
+  Module* const top = d->getTopModules()->front();
+
+  std::vector<Net*> nets;
+  for (int32_t i = 0; i < 4; ++i) {
+    nets.emplace_back(serializer.make<Net>());
+    nets.back()->setName("n" + std::to_string(i));
+  }
+  serializer.erase(nets[0]);
+  for (int32_t i = 1; i < 4; ++i) nets[i]->setParent(top);
+
+  const Factory* const factory = serializer.getFactory<Net>();
+  ASSERT_EQ(factory->getObjects().size(), 4);
+  for (uint32_t i = 0; i < factory->getObjects().size(); ++i) {
+    EXPECT_EQ(factory->getObjects()[i]->getSlot(), i);
+  }
+
+  // Saved references are slots.
+  const std::string orig = designs_to_string(designs);
+  const std::string filename = testing::TempDir() + "/serializer-slots.uhdm";
+  serializer.save(filename);
+  const std::vector<vpiHandle> restored = serializer.restore(filename);
+  ASSERT_EQ(restored.size(), 1);
+  EXPECT_EQ(orig, designs_to_string(restored));
+}
+
+TEST(Serializer, FactorySlabs) {
+  Serializer serializer;
+  serializer.make<Net>(100);
+  const std::vector<Any*>& nets = serializer.getFactory<Net>()->getObjects();
+  ASSERT_EQ(nets.size(), 100);
+  // Objects made together are laid out contiguously.
+  const ptrdiff_t stride = (const char*)nets[1] - (const char*)nets[0];
+  EXPECT_GE(stride, (ptrdiff_t)sizeof(Net));
+  for (size_t i = 1; i < nets.size(); ++i) {
+    EXPECT_EQ((const char*)nets[i] - (const char*)nets[i - 1], stride);
+  }
+
+  // The storage of erased objects is reused.
+  const Net* const erased = (const Net*)nets[10];
+  serializer.erase(erased);
+  EXPECT_EQ(serializer.make<Net>(), erased);
+  EXPECT_EQ(serializer.getFactory<Net>()->getObjects().size(), 100);
+
+  // So are collections, of any type.
+  const std::vector<Net*>* const first = serializer.makeCollection<Net>();
+  const std::vector<Port*>* const second = serializer.makeCollection<Port>();
+  const ptrdiff_t distance = (const char*)second - (const char*)first;
+  EXPECT_GE(distance, (ptrdiff_t)sizeof(std::vector<Net*>));
+  EXPECT_LT(distance, (ptrdiff_t)(2 * sizeof(std::vector<Net*>)));
+}
+
+TEST(Serializer, EraseAll) {
+  Serializer serializer;
+  std::vector<const Any*> erased;
+  std::vector<const Any*> kept;
+  for (int32_t i = 0; i < 1000; ++i) {
+    Net* n = serializer.make<Net>();
+    n->setName("n" + std::to_string(i));
+    ((i % 3 == 0) ? erased : kept).emplace_back(n);
+  }
+  erased.emplace_back(nullptr);
+  EXPECT_EQ(serializer.eraseAll(erased), 334);
+
+  // Survivors keep their order and their slots follow it.
+  const std::vector<Any*>& nets = serializer.getFactory<Net>()->getObjects();
+  ASSERT_EQ(nets.size(), kept.size());
+  for (uint32_t i = 0; i < nets.size(); ++i) {
+    EXPECT_EQ(nets[i], kept[i]);
+    EXPECT_EQ(nets[i]->getSlot(), i);
+  }
+  EXPECT_EQ(serializer.getObjectStats()["Net"], kept.size());
+}
+
+TEST(Serializer, ClientData) {
+  Serializer serializer;
+  Module* const m1 = serializer.make<Module>();
+  Module* const m2 = serializer.make<Module>();
+  EXPECT_EQ(m1->getClientData(), nullptr);
+
+  ClientData data1;
+  ClientData data2;
+  m1->setClientData(&data1);
+  m2->setClientData(&data2);
+  EXPECT_EQ(m1->getClientData(), &data1);
+  EXPECT_EQ(m2->getClientData(), &data2);
+
+  // Erased objects take their client data with them.
+  serializer.erase(m1);
+  Module* const m3 = serializer.make<Module>();
+  EXPECT_EQ(m3->getClientData(), nullptr);
+
+  // Copies take the client data of their source, kept by its serializer.
+  Serializer other;
+  Module* const m4 = other.make<Module>();
+  ClientData data4;
+  m4->setClientData(&data4);
+  *m2 = *m4;
+  EXPECT_EQ(m2->getSerializer(), &other);
+  EXPECT_EQ(m2->getClientData(), &data4);
+  *m2 = *m3;
+  EXPECT_EQ(m2->getClientData(), nullptr);
+
+  m4->setClientData(nullptr);
+  EXPECT_EQ(m4->getClientData(), nullptr);
+}
+
+TEST(Serializer, GetByVpiName) {
+  Serializer serializer;
+  Module* const m = serializer.make<Module>();
+  for (const char* name : {"a", "b", "c"}) {
+    Net* const n = serializer.make<Net>();
+    n->setName(name);
+    n->setParent(m);
+  }
+  EXPECT_EQ(m->getByVpiName("b"), m->getNets()->at(1));
+  // Not even a symbol.
+  EXPECT_EQ(m->getByVpiName("d"), nullptr);
+  // A symbol, but of no net.
+  serializer.makeSymbol("d");
+  EXPECT_EQ(m->getByVpiName("d"), nullptr);
+}
+
+TEST(Serializer, ReferrerIndex) {
+  Serializer serializer;
+  Module* const m1 = serializer.make<Module>();
+  Module* const m2 = serializer.make<Module>();
+  Module* const m3 = serializer.make<Module>();
+  std::vector<Net*> nets;
+  for (int32_t i = 0; i < 3; ++i) {
+    nets.emplace_back(serializer.make<Net>());
+    nets.back()->setParent(m1);
+  }
+  RefObj* const ref = serializer.make<RefObj>();
+  m3->setNets(serializer.makeCollection<Net>());
+  serializer.indexReferrers();
+  EXPECT_TRUE(serializer.hasReferrerIndex());
+
+  // Swaps keep the index up to date for the next ones.
+  serializer.swap(m1, m2);
+  for (Net* n : nets) EXPECT_EQ(n->getParent(), m2);
+  serializer.erase(nets.back());
+  nets.pop_back();
+  serializer.swap({{m2, m3}, {m3, m1}});
+  for (Net* n : nets) EXPECT_EQ(n->getParent(), m3);
+  serializer.swap(m3, m1);
+  for (Net* n : nets) EXPECT_EQ(n->getParent(), m1);
+
+  // References set since, by setters or in collections got for editing and
+  // on new objects or not, are indexed again before the next swap.
+  Net* const a = serializer.make<Net>();
+  Net* const b = serializer.make<Net>();
+  ref->setActual(a);
+  m3->getNets(true)->emplace_back(a);
+  serializer.swap(a, b);
+  EXPECT_EQ(ref->getActual(), b);
+  EXPECT_EQ(m3->getNets()->back(), b);
+  ref->setActual(m2);
+  serializer.swap(b, a);
+  EXPECT_EQ(ref->getActual(), m2);
+  EXPECT_EQ(m3->getNets()->back(), a);
+
+  serializer.clearReferrers();
+  EXPECT_FALSE(serializer.hasReferrerIndex());
+  serializer.swap(m1, m2);
+  for (Net* n : nets) EXPECT_EQ(n->getParent(), m2);
+}
+
+TEST(Serializer, MemoryStats) {
+  Serializer serializer;
+  std::vector<Net*>* const nets = serializer.makeCollection<Net>();
+  for (int32_t i = 0; i < 10; ++i) {
+    Net* const n = serializer.make<Net>();
+    n->setName((i % 2 == 0) ? "even_net" : "odd_net");
+    n->setFile("top.sv");
+    nets->emplace_back(n);
+  }
+  serializer.make<Port>()->setName("even_net");
+
+  const Serializer::MemoryStats stats = serializer.getMemoryStats();
+  const Serializer::MemoryStats::Usage& net = stats.types.at(UhdmType::Net);
+  EXPECT_GE(net.objects, 10 * sizeof(Net));
+  EXPECT_GE(net.collections, 10 * sizeof(Net*));
+  // Distinct symbols are counted once per type.
+  EXPECT_EQ(net.symbols, strlen("even_net") + strlen("odd_net") +
+                             strlen("top.sv"));
+  EXPECT_EQ(stats.types.at(UhdmType::Port).symbols, strlen("even_net"));
+  EXPECT_EQ(stats.types.count(UhdmType::Module), 0);
+  EXPECT_GT(stats.symbolTable, 0);
+}
+
+TEST(Serializer, FileInfo) {
+  Serializer serializer;
+  buildDesign(&serializer);
+
+  const std::string filename = testing::TempDir() + "/serializer-info.uhdm";
+  serializer.save(filename);
+  std::map<std::string, uint32_t, std::less<>> stats =
+      serializer.getObjectStats();
+  for (auto it = stats.begin(); it != stats.end();) {
+    it = (it->second == 0) ? stats.erase(it) : std::next(it);
+  }
+
+  Serializer::FileInfo info;
+  ASSERT_TRUE(Serializer::readFileInfo(filename, &info));
+  EXPECT_EQ(info.version, Serializer::kVersion);
+  EXPECT_EQ(info.encoding, Serializer::Encoding::Packed);
+  EXPECT_GT(info.symbolCount, 0);
+  EXPECT_EQ(info.objectStats, stats);
+  EXPECT_EQ(info.objectStats["Module"], 2);
+
+  // A lazy restore counts the objects not created yet from the file.
+  Serializer::RestoreOptions options;
+  options.lazy = true;
+  ASSERT_EQ(serializer.restore(filename, options).size(), 1);
+  std::map<std::string, uint32_t, std::less<>> lazyStats =
+      serializer.getObjectStats();
+  for (auto it = lazyStats.begin(); it != lazyStats.end();) {
+    it = (it->second == 0) ? lazyStats.erase(it) : std::next(it);
+  }
+  EXPECT_EQ(lazyStats, stats);
+
+  EXPECT_FALSE(Serializer::readFileInfo(
+      testing::TempDir() + "/does-not-exist.uhdm", &info));
+}
+
+TEST(Serializer, UnsupportedVersion) {
+  Serializer serializer;
+  buildDesign(&serializer);
+  const std::string filename =
+      testing::TempDir() + "/serializer-version.uhdm";
+  serializer.save(filename);
+
+  // The version follows the magic number in the header.
+  const uint32_t version = Serializer::kVersion + 1;
+  {
+    std::fstream file(filename,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  }
+
+  Serializer::FileInfo info;
+  ASSERT_TRUE(Serializer::readFileInfo(filename, &info));
+  EXPECT_EQ(info.version, version);
+  EXPECT_TRUE(info.objectStats.empty());
+
+  std::vector<ErrorType> errors;
+  serializer.setErrorHandler([&errors](ErrorType errType, const std::string&,
+                                       const Any*, const Any*) {
+    errors.emplace_back(errType);
+  });
+  EXPECT_TRUE(serializer.restore(filename).empty());
+  EXPECT_EQ(errors, std::vector<ErrorType>{UHDM_UNSUPPORTED_FILE_VERSION});
+}
+
+TEST(Serializer, SelectiveRestore) {
+  Serializer serializer;
+  buildDesign(&serializer);
+
+  const std::string filename =
+      testing::TempDir() + "/serializer-selective.uhdm";
+  serializer.save(filename);
+
+  // By type, abstract ones included.
+  Serializer::RestoreOptions options;
+  options.types = {UhdmType::Ports};
+  std::vector<vpiHandle> restored = serializer.restore(filename, options);
+  ASSERT_EQ(restored.size(), 1);
+  const Port* const p =
+      (const Port*)((const uhdm_handle*)restored.front())->object;
+  EXPECT_EQ(p->getName(), "i1");
+  ASSERT_NE(p->getHighConn(), nullptr);
+  const RefObj* const r = p->getHighConn()->Cast<RefObj>();
+  ASSERT_NE(r, nullptr);
+  ASSERT_NE(r->getActual(), nullptr);
+  EXPECT_EQ(r->getActual()->getName(), "w");
+  // Parents are there, without their relations.
+  ASSERT_NE(p->getParent<Module>(), nullptr);
+  EXPECT_EQ(p->getParent<Module>()->getNets(), nullptr);
+  EXPECT_TRUE(serializer.getFactory<Function>()->getObjects().empty());
+
+  // By instance path.
+  options.types.clear();
+  options.instancePath = "work@top.u1";
+  restored = serializer.restore(filename, options);
+  ASSERT_EQ(restored.size(), 1);
+  const Module* const m =
+      (const Module*)((const uhdm_handle*)restored.front())->object;
+  EXPECT_EQ(m->getName(), "u1");
+  ASSERT_NE(m->getNets(), nullptr);
+  EXPECT_EQ(m->getNets()->size(), 1);
+  ASSERT_NE(m->getPorts(), nullptr);
+  EXPECT_EQ(m->getPorts()->size(), 1);
+  EXPECT_EQ(serializer.getFactory<Module>()->getObjects().size(), 2);
+  EXPECT_TRUE(serializer.getFactory<Function>()->getObjects().empty());
+
+  options.instancePath = "top.nope";
+  EXPECT_TRUE(serializer.restore(filename, options).empty());
+}
+
+TEST(Serializer, SelectiveRestoreThenSave) {
+  Serializer serializer;
+  buildDesign(&serializer);
+  const std::string filename =
+      testing::TempDir() + "/serializer-selective-full.uhdm";
+  serializer.save(filename);
+
+  // Not reachable from the design, the selection isn't collected as garbage.
+  Serializer::RestoreOptions options;
+  options.types = {UhdmType::Ports};
+  ASSERT_EQ(serializer.restore(filename, options).size(), 1);
+  const std::string partial =
+      testing::TempDir() + "/serializer-selective-partial.uhdm";
+  serializer.save(partial);
+  EXPECT_EQ(serializer.getFactory<Port>()->getObjects().size(), 1);
+
+  const std::vector<vpiHandle> restored = serializer.restore(partial);
+  ASSERT_EQ(restored.size(), 1);
+  EXPECT_EQ(serializer.getFactory<Port>()->getObjects().size(), 1);
+  EXPECT_EQ(serializer.getFactory<Net>()->getObjects().size(), 1);
+  EXPECT_TRUE(serializer.getFactory<Function>()->getObjects().empty());
+}
+
+TEST(Serializer, DeltaSave) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const std::string base = testing::TempDir() + "/serializer-base.uhdm";
+  serializer.save(base);
+
+  // Create, modify and erase objects.
+  const Design* const d =
+      (const Design*)((const uhdm_handle*)designs.front())->object;
+  Module* const top = d->getTopModules()->front();
+  Net* const n = serializer.make<Net>();
+  n->setName("added");
+  n->setParent(top);
+  Function* const f = top->getTaskFuncs()->front()->Cast<Function>();
+  ASSERT_NE(f, nullptr);
+  f->setParent(nullptr);
+  serializer.erase(f);
+  top->setDefName("M1b");
+  // Edited in place, reading the collection doesn't flag the module but the
+  // caller does.
+  Module* const u1 = top->getModules()->front();
+  u1->getNets()->clear();
+  EXPECT_FALSE(u1->isModified());
+  u1->touch();
+  EXPECT_TRUE(u1->isModified());
+  const std::string orig = designs_to_string(designs);
+
+  const std::string patch = testing::TempDir() + "/serializer-patch.uhdm";
+  Serializer::SaveOptions saveOptions;
+  saveOptions.delta = true;
+  serializer.save(patch, saveOptions);
+
+  Serializer::FileInfo info;
+  ASSERT_TRUE(Serializer::readFileInfo(patch, &info));
+  EXPECT_TRUE(info.patch);
+  EXPECT_EQ(info.objectStats["Net"], 1);
+  EXPECT_EQ(info.objectStats["Module"], 2);
+  EXPECT_EQ(info.objectStats.count("Function"), 0);
+  EXPECT_EQ(info.objectStats.count("Port"), 0);
+
+  // A patch can't be restored without its snapshot.
+  EXPECT_TRUE(serializer.restore(patch).empty());
+
+  Serializer::RestoreOptions options;
+  options.patch = patch;
+  std::vector<vpiHandle> restored = serializer.restore(base, options);
+  ASSERT_EQ(restored.size(), 1);
+  EXPECT_EQ(orig, designs_to_string(restored));
+  EXPECT_TRUE(serializer.getFactory<Function>()->getObjects().empty());
+
+  // Patches are cumulative, the next one still applies to the snapshot.
+  const Design* const patched =
+      (const Design*)((const uhdm_handle*)restored.front())->object;
+  patched->getTopModules()->front()->setName("top2");
+  const std::string cumulated = designs_to_string(restored);
+  serializer.save(patch, saveOptions);
+  restored = serializer.restore(base, options);
+  ASSERT_EQ(restored.size(), 1);
+  EXPECT_EQ(cumulated, designs_to_string(restored));
+
+  // A full save starts over from a new snapshot.
+  serializer.save(base);
+  restored = serializer.restore(base, options);
+  EXPECT_TRUE(restored.empty());
+}
+
+TEST(Serializer, CompactSymbols) {
+  Serializer serializer;
+  const std::vector<vpiHandle> designs = buildDesign(&serializer);
+  const Design* const d =
+      (const Design*)((const uhdm_handle*)designs.front())->object;
+  Module* const top = d->getTopModules()->front();
+  top->setDefName("unused");
+  top->setDefName("zz_top");
+  serializer.makeSymbol("temporary");
+  const SymbolId unused = serializer.getSymbolId("unused");
+  const SymbolId zzTop = serializer.getSymbolId("zz_top");
+  const std::string orig = designs_to_string(designs);
+
+  // Only the file is renumbered, the ids held in memory stay valid.
+  const std::string filename = testing::TempDir() + "/serializer-compact.uhdm";
+  serializer.save(filename);
+  EXPECT_EQ(orig, designs_to_string(designs));
+  EXPECT_EQ(serializer.getSymbolId("unused"), unused);
+  EXPECT_EQ(serializer.getSymbolId("zz_top"), zzTop);
+  EXPECT_EQ(serializer.getSymbol(zzTop), "zz_top");
+
+  // Sorted by text, the last symbol has the last id.
+  Serializer::FileInfo info;
+  ASSERT_TRUE(Serializer::readFileInfo(filename, &info));
+  Serializer restored;
+  EXPECT_EQ(orig, designs_to_string(restored.restore(filename)));
+  EXPECT_EQ(restored.getSymbolId("unused"), BadSymbolId);
+  EXPECT_EQ(restored.getSymbolId("temporary"), BadSymbolId);
+  EXPECT_EQ((RawSymbolId)restored.getSymbolId("zz_top"), info.symbolCount - 1);
+
+  // Deltas use the ids of the file, the symbols it left out are new to them.
+  top->setDefName("unused");
+  const std::string changed = designs_to_string(designs);
+  const std::string patch =
+      testing::TempDir() + "/serializer-compact-patch.uhdm";
+  Serializer::SaveOptions saveOptions;
+  saveOptions.delta = true;
+  serializer.save(patch, saveOptions);
+  ASSERT_TRUE(Serializer::readFileInfo(patch, &info));
+  EXPECT_EQ(info.symbolCount, 1U);
+  Serializer::RestoreOptions restoreOptions;
+  restoreOptions.patch = patch;
+  EXPECT_EQ(changed,
+            designs_to_string(restored.restore(filename, restoreOptions)));
+
+  // Not compacted, the file holds every symbol.
+  Serializer::SaveOptions options;
+  options.compactSymbols = false;
+  const SymbolId last = serializer.makeSymbol("last");
+  serializer.save(filename, options);
+  ASSERT_TRUE(Serializer::readFileInfo(filename, &info));
+  EXPECT_EQ((RawSymbolId)last + 1, info.symbolCount);
+}
@@ -14,6 +14,7 @@
  limitations under the License.
 */
 
+#include <set>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -21,6 +22,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "uhdm/SymbolFactory.h"
+#include "uhdm/ThreadPool.h"
 
 namespace uhdm {
 using testing::ElementsAre;
@@ -87,5 +89,55 @@ TEST(SymbolFactoryTest, SymbolStringsAreStable) {
   EXPECT_EQ(before_data, after_data);
 }
 
+TEST(SymbolFactoryTest, ConcurrentAdd) {
+  SymbolFactory table;
+  constexpr size_t kSymbolCount = 20000;
+  // Every symbol is added by several tasks at once.
+  std::vector<SymbolId> ids(4 * kSymbolCount);
+  ThreadPool::parallelFor(8, ids.size(), [&](size_t i) {
+    const std::string symbol = "s" + std::to_string(i % kSymbolCount);
+    ids[i] = table.registerSymbol(symbol);
+    EXPECT_EQ(table.getSymbol(ids[i]), symbol);
+  });
+
+  // Ids are dense, one per symbol.
+  EXPECT_EQ(table.getSymbolCount(), kSymbolCount + 1);
+  std::set<RawSymbolId> unique;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    EXPECT_EQ(ids[i], ids[i % kSymbolCount]);
+    unique.emplace((RawSymbolId)ids[i]);
+  }
+  EXPECT_EQ(unique.size(), kSymbolCount);
+  EXPECT_EQ(*unique.begin(), 1);
+  EXPECT_EQ(*unique.rbegin(), kSymbolCount);
+  EXPECT_EQ(table.getId("s123"), ids[123]);
+}
+
+TEST(SymbolFactoryTest, AppendUnique) {
+  SymbolFactory table;
+  const SymbolId foo_id = table.registerSymbol("foo");
+
+  std::vector<std::string> storage;
+  for (int32_t i = 0; i < 3000; ++i) {
+    storage.emplace_back("s" + std::to_string(i));
+  }
+  storage.emplace_back("");
+  const std::vector<std::string_view> symbols(storage.begin(), storage.end());
+  table.appendUnique(symbols.data(), symbols.size());
+
+  // Ids follow the existing ones, in order, the text is kept.
+  ASSERT_EQ(table.getSymbolCount(), symbols.size() + 2);
+  for (size_t i = 0; i < symbols.size(); ++i) {
+    EXPECT_EQ(table.getSymbol(SymbolId(i + 2, "")), symbols[i]);
+  }
+
+  // Lookups and adds see the appended symbols.
+  EXPECT_EQ(table.getId("s1234"), SymbolId(1236, ""));
+  EXPECT_EQ(table.registerSymbol("s2999"), SymbolId(3001, ""));
+  EXPECT_EQ(table.registerSymbol("foo"), foo_id);
+  EXPECT_EQ(table.registerSymbol("bar"), SymbolId(symbols.size() + 2, ""));
+  EXPECT_EQ(table.getSymbolCount(), symbols.size() + 3);
+}
+
 }  // namespace
 }  // namespace uhdm
@@ -129,3 +129,158 @@ TEST(UhdmListenerTest, ProgramModule) {
   EXPECT_EQ(listener->collected(), expected);
   EXPECT_TRUE(listener->didVisitAll(serializer));
 }
+
+class ModuleNameCollector final : public UhdmListener {
+ public:
+  explicit ModuleNameCollector(bool parallel) : parallel_(parallel) {}
+
+  const std::vector<std::string>& names() const { return names_; }
+
+ protected:
+  void enterModule(const Module* object, uint32_t vpiRelation) override {
+    if (vpiRelation == vpiTopModules) {
+      EXPECT_EQ(getCallstack().size(), 1);
+      EXPECT_EQ(getCallstack().back()->getUhdmType(), UhdmType::Design);
+    }
+    names_.emplace_back(object->getName());
+  }
+
+  std::unique_ptr<UhdmListener> makeWorker() const override {
+    if (!parallel_) return nullptr;
+    return std::make_unique<ModuleNameCollector>(false);
+  }
+
+  void mergeWorker(UhdmListener* worker) override {
+    const std::vector<std::string>& names =
+        static_cast<ModuleNameCollector*>(worker)->names_;
+    names_.insert(names_.end(), names.begin(), names.end());
+  }
+
+ private:
+  const bool parallel_;
+  std::vector<std::string> names_;
+};
+
+TEST(UhdmListenerTest, ListenTopModulesInParallel) {
+  Serializer serializer;
+  Design* const design = serializer.make<Design>();
+  for (int32_t i = 0; i < 8; ++i) {
+    const std::string name = "top" + std::to_string(i);
+    Module* const top = serializer.make<Module>();
+    top->setTopModule(true);
+    top->setName(name);
+    top->setParent(design);
+    design->getTopModules(true)->emplace_back(top);
+    for (int32_t j = 0; j < 3; ++j) {
+      Module* const child = serializer.make<Module>();
+      child->setName(name + ".u" + std::to_string(j));
+      child->setParent(top);
+    }
+  }
+
+  ModuleNameCollector sequential(false);
+  sequential.listenTopModules(design, 4);
+  EXPECT_EQ(sequential.names().front(), "top0");
+  EXPECT_EQ(sequential.names().back(), "top7.u2");
+
+  ModuleNameCollector parallel(true);
+  parallel.listenTopModules(design, 4);
+  EXPECT_EQ(parallel.names(), sequential.names());
+  EXPECT_EQ(parallel.getVisited().toSet(), sequential.getVisited().toSet());
+
+  // Restored lazily, the design is materialized before the workers start.
+  const std::string filename = testing::TempDir() + "/listen-top-modules.uhdm";
+  serializer.save(filename);
+  Serializer::RestoreOptions options;
+  options.lazy = true;
+  const std::vector<vpiHandle> restored = serializer.restore(filename, options);
+  ASSERT_EQ(restored.size(), 1);
+  ModuleNameCollector lazy(true);
+  lazy.listenTopModules(
+      (const Design*)((const uhdm_handle*)restored.front())->object, 4);
+  EXPECT_EQ(lazy.names(), sequential.names());
+}
+
+class CallbackRecorder final : public UhdmListener {
+ public:
+  const std::vector<std::string>& events() const { return events_; }
+  size_t maxDepth() const { return maxDepth_; }
+
+ protected:
+  void enterAny(const Any* object, uint32_t vpiRelation) override {
+    Record("enterAny", object, vpiRelation);
+  }
+
+  void leaveAny(const Any* object, uint32_t vpiRelation) override {
+    Record("leaveAny", object, vpiRelation);
+  }
+
+  void enterModule(const Module* object, uint32_t vpiRelation) override {
+    Record("enterModule", object, vpiRelation);
+  }
+
+  void leaveModule(const Module* object, uint32_t vpiRelation) override {
+    Record("leaveModule", object, vpiRelation);
+  }
+
+  void enterModuleCollection(const Any* object,
+                             const ModuleCollection& objects,
+                             uint32_t vpiRelation) override {
+    Record("enterModuleCollection", object, vpiRelation);
+  }
+
+  void leaveModuleCollection(const Any* object,
+                             const ModuleCollection& objects,
+                             uint32_t vpiRelation) override {
+    Record("leaveModuleCollection", object, vpiRelation);
+  }
+
+ private:
+  void Record(const char* callback, const Any* object, uint32_t vpiRelation) {
+    maxDepth_ = std::max(maxDepth_, getCallstack().size());
+    if (maxDepth_ > 1000) return;  // Keep deep walks cheap.
+    events_.emplace_back(std::string(callback) + " " +
+                         std::to_string(object->getUhdmId()) + " " +
+                         std::to_string(vpiRelation) + " " +
+                         std::to_string(getCallstack().size()));
+  }
+
+  std::vector<std::string> events_;
+  size_t maxDepth_ = 0;
+};
+
+TEST(UhdmListenerTest, IterativeMatchesRecursive) {
+  Serializer serializer;
+  const Design* const design = buildModuleProg(&serializer);
+
+  CallbackRecorder recursive;
+  recursive.listenAny(design);
+
+  CallbackRecorder iterative;
+  iterative.setIterative(true);
+  iterative.listenAny(design);
+
+  EXPECT_FALSE(recursive.events().empty());
+  EXPECT_EQ(iterative.events(), recursive.events());
+  EXPECT_TRUE(iterative.didVisitAll(serializer));
+}
+
+TEST(UhdmListenerTest, IterativeWalksDeepTrees) {
+  constexpr int32_t kDepth = 100000;
+  Serializer serializer;
+  Begin* const root = serializer.make<Begin>();
+  Begin* parent = root;
+  for (int32_t i = 0; i < kDepth; ++i) {
+    Begin* const child = serializer.make<Begin>();
+    child->setParent(parent);
+    parent->getStmts(true)->emplace_back(child);
+    parent = child;
+  }
+
+  CallbackRecorder listener;
+  listener.setIterative(true);
+  listener.listenAny(root);
+  EXPECT_EQ(listener.maxDepth(), kDepth);
+  EXPECT_TRUE(listener.getCallstack().empty());
+  EXPECT_TRUE(listener.didVisitAll(serializer));
+}
@@ -0,0 +1,70 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ Copyright 2022 The UHDM Team.
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "uhdm/VisitedSet.h"
+#include "uhdm/uhdm.h"
+
+namespace uhdm {
+namespace {
+TEST(VisitedSetTest, BehavesLikeSet) {
+  // Both serializers hand out the same ids, the second batch collides.
+  Serializer serializer1;
+  Serializer serializer2;
+  std::vector<const Any*> objects;
+  for (int32_t i = 0; i < 5000; ++i) {
+    objects.emplace_back(serializer1.make<Constant>());
+  }
+  for (int32_t i = 0; i < 10; ++i) {
+    objects.emplace_back(serializer2.make<Constant>());
+  }
+
+  VisitedSet visited;
+  for (const Any* object : objects) {
+    EXPECT_FALSE(visited.contains(object));
+    EXPECT_EQ(visited.find(object), visited.end());
+    EXPECT_TRUE(visited.emplace(object).second);
+    EXPECT_FALSE(visited.insert(object).second);
+    EXPECT_NE(visited.find(object), visited.end());
+    EXPECT_EQ(*visited.find(object), object);
+  }
+  EXPECT_EQ(visited.size(), objects.size());
+
+  const std::set<const Any*> expected(objects.begin(), objects.end());
+  EXPECT_EQ(visited.toSet(), expected);
+  EXPECT_EQ(std::set<const Any*>(visited.cbegin(), visited.cend()), expected);
+
+  // Erasing an object whose id is shared keeps the other one findable.
+  EXPECT_EQ(visited.erase(objects[0]), 1);
+  EXPECT_EQ(visited.erase(objects[0]), 0);
+  EXPECT_FALSE(visited.contains(objects[0]));
+  EXPECT_TRUE(visited.contains(objects[5000]));
+  EXPECT_EQ(visited.erase(objects[5000]), 1);
+  EXPECT_EQ(visited.size(), objects.size() - 2);
+
+  const VisitedSet copy = visited;
+  visited.clear();
+  EXPECT_TRUE(visited.empty());
+  EXPECT_EQ(visited.begin(), visited.end());
+  EXPECT_EQ(copy.size(), objects.size() - 2);
+  EXPECT_TRUE(copy.contains(objects[1]));
+  EXPECT_TRUE(copy.contains(objects[5001]));
+}
+}  // namespace
+}  // namespace uhdm
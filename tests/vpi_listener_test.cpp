@@ -143,3 +143,19 @@ TEST(UhdmListenerTracerTest, ProgramModule) {
   listener->listenDesigns(design);
   EXPECT_THAT(out.str(), HasSubstr("enterDesign: [0,0:0,0]"));
 }
+
+TEST(VpiListenerTest, IterativeMatchesRecursive) {
+  Serializer serializer;
+  const std::vector<vpiHandle>& design = buildModuleProg(&serializer);
+
+  std::stringstream recursive;
+  VpiListenerTracer(recursive).listenDesigns(design);
+
+  std::stringstream iterative;
+  VpiListenerTracer listener(iterative);
+  listener.setIterative(true);
+  listener.listenDesigns(design);
+
+  EXPECT_THAT(recursive.str(), HasSubstr("leaveModule"));
+  EXPECT_EQ(iterative.str(), recursive.str());
+}
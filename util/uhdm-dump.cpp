@@ -77,7 +77,10 @@ static int32_t usage(const char *progname) {
   fprintf(stderr,
           "Options:\n"
           "\t--elab          : Elaborate the restored design.\n"
-          "\t--stats         : Print objects counts (by type).\n"
+          "\t--stats         : Print objects counts (by type) only, without "
+          "restoring.\n"
+          "\t                  With --elab or a golden file, also print memory "
+          "usage.\n"
           "\t--verbose       : print diagnostic messages.\n"
           "\t--version       : print version and exit.\n"
           "\nIf golden file is given to compare, exit code represent if output "
@@ -127,6 +130,18 @@ int32_t main(int32_t argc, char **argv) {
     return usage(argv[0]);
   }
 
+  if (dumpstats) {
+    // Counts come from the table of contents of the file, read without
+    // restoring it.
+    Serializer::FileInfo info;
+    if (!Serializer::readFileInfo(uhdmFile, &info)) {
+      std::cerr << uhdmFile << ": not a readable UHDM file." << std::endl;
+      return 1;
+    }
+    Serializer::printStats(std::cout, uhdmFile, info.objectStats);
+    if (!elab && goldenFile.empty()) return 0;
+  }
+
   Serializer serializer;
   if (verbose) std::cerr << uhdmFile << ": restoring from file" << std::endl;
   std::vector<vpiHandle> restoredDesigns = serializer.restore(uhdmFile);
@@ -137,7 +152,7 @@ int32_t main(int32_t argc, char **argv) {
   }
 
   if (dumpstats) {
-    serializer.printStats(std::cout, uhdmFile);
+    serializer.printMemoryStats(std::cout, uhdmFile);
 
     if (!goldenFile.empty()) {
       serializer.printStats(std::cout, goldenFile);
@@ -73,8 +73,11 @@ int32_t main(int32_t argc, char** argv) {
     return usage(argv[0]);
   }
 
+  // Only the instance tree is walked, restore just what it reaches.
   Serializer serializer;
-  std::vector<vpiHandle> restoredDesigns = serializer.restore(uhdmFile);
+  Serializer::RestoreOptions options;
+  options.lazy = true;
+  std::vector<vpiHandle> restoredDesigns = serializer.restore(uhdmFile, options);
 
   if (restoredDesigns.empty()) {
     std::cerr << uhdmFile << ": empty design." << std::endl;
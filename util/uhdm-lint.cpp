@@ -181,6 +181,9 @@ int32_t main(int32_t argc, char** argv) {
                 "Critical: Forcing signal to unsigned type due to unsigned "
                 "port binding ";
             break;
+          case uhdm::UHDM_UNSUPPORTED_FILE_VERSION:
+            errmsg = "Unsupported file version";
+            break;
         }
 
         if (object1) {